@@ -1,4 +1,6 @@
 from itertools import combinations, pairwise
+import ctypes
+import os
 import string
 import cProfile
 
@@ -52,6 +54,142 @@ def encode(text):
     return np.array([ctoi[c] for c in text])
 
 
+class NativeCore:
+    """
+    ctypes bindings of the C++ core, build/libanalysis.so (`make shared`).
+    See include/capi.h for the functions.
+
+    Arrays go to the library as pointers to their data: a C-contiguous uint8
+    (or int64) numpy array is not copied, and the results are written into
+    arrays allocated here.
+    """
+
+    ABI_VERSION = 1
+    OK = 0
+    NO_ANSWER = -1
+
+    def __init__(self, path):
+        lib = ctypes.CDLL(path)
+        lib.analysis_abi_version.restype = ctypes.c_int
+        if lib.analysis_abi_version() != self.ABI_VERSION:
+            raise RuntimeError(f'{path} does not have ABI version {self.ABI_VERSION}')
+
+        u8 = np.ctypeslib.ndpointer(dtype=np.uint8, flags='C_CONTIGUOUS')
+        u64 = np.ctypeslib.ndpointer(dtype=np.uint64, flags='C_CONTIGUOUS')
+        i64 = np.ctypeslib.ndpointer(dtype=np.int64, flags='C_CONTIGUOUS')
+        f64 = np.ctypeslib.ndpointer(dtype=np.float64, flags='C_CONTIGUOUS')
+        size = ctypes.c_size_t
+
+        def declare(name, restype, *argtypes):
+            f = getattr(lib, name)
+            f.restype = restype
+            f.argtypes = argtypes
+            return f
+
+        self._encode = declare('analysis_encode', ctypes.c_int, ctypes.c_char_p, size, u8)
+        self._diff = declare('analysis_diff', ctypes.c_int, u8, u8, size, u8)
+        self._entropy = declare('analysis_entropy', ctypes.c_int, u8, size,
+                                ctypes.POINTER(ctypes.c_double))
+        self._removal_entropies = declare(
+            'analysis_removal_entropies', ctypes.c_int,
+            u8, size, u8, size, i64, size, size, f64)
+        self._candidates_view = declare(
+            'analysis_candidates_view', ctypes.c_void_p, u8, u64, size, size)
+        self._candidates_free = declare('analysis_candidates_free', None, ctypes.c_void_p)
+        self._decide = declare(
+            'analysis_decide', ctypes.c_int, ctypes.c_void_p, ctypes.c_char_p, size,
+            size, ctypes.POINTER(size), ctypes.POINTER(size))
+
+    @staticmethod
+    def _symbols(stream):
+        # No copy if it already is a contiguous uint8 array
+        return np.ascontiguousarray(stream, dtype=np.uint8)
+
+    def _check(self, status, what):
+        if status != self.OK:
+            raise ValueError(f'{what} failed with status {status}')
+
+    def encode(self, text):
+        data = text.encode('ascii')
+        out = np.empty(len(data), dtype=np.uint8)
+        self._check(self._encode(data, len(data), out), 'encode')
+        return out
+
+    def stream_diff(self, s1, s2):
+        s1 = self._symbols(s1)
+        s2 = self._symbols(s2)
+        n = min(len(s1), len(s2))
+        out = np.empty(n, dtype=np.uint8)
+        self._check(self._diff(s1, s2, n, out), 'stream_diff')
+        return out
+
+    def entropy(self, data):
+        data = self._symbols(data)
+        ent = ctypes.c_double()
+        self._check(self._entropy(data, len(data), ctypes.byref(ent)), 'entropy')
+        return ent.value
+
+    def removal_entropies(self, cipher_stream, plain_stream, N, removal_sets):
+        """
+        Entropy of the first N diffs against `plain_stream` without each row of
+        positions of `removal_sets`, a (n_sets, n_remove) array
+        """
+        cipher_stream = self._symbols(cipher_stream)
+        plain_stream = self._symbols(plain_stream)
+        removal_sets = np.ascontiguousarray(removal_sets, dtype=np.int64)
+        n_sets, n_remove = removal_sets.shape
+        out = np.empty(n_sets, dtype=np.float64)
+        self._check(self._removal_entropies(
+            cipher_stream, len(cipher_stream), plain_stream, N,
+            removal_sets, n_sets, n_remove, out), 'removal_entropies')
+        return out
+
+    def decide(self, ciphertext, candidates, search_space=0):
+        """
+        EntropyAnalysis::run over `candidates`; search_space 0 grows it as
+        needed. Returns (candidate index or -1, search space that decided)
+        """
+        streams = [self.encode(c) for c in candidates]
+        stride = max(len(s) for s in streams)
+        rows = np.zeros((len(streams), stride), dtype=np.uint8)
+        for i, s in enumerate(streams):
+            rows[i, :len(s)] = s
+        lengths = np.array([len(s) for s in streams], dtype=np.uint64)
+
+        # The candidates are a view of rows and lengths, which outlive them
+        handle = self._candidates_view(rows, lengths, len(streams), stride)
+        if not handle:
+            raise ValueError('invalid candidates')
+        try:
+            data = ciphertext.encode('ascii')
+            answer = ctypes.c_size_t()
+            decided = ctypes.c_size_t()
+            status = self._decide(handle, data, len(data), search_space,
+                                  ctypes.byref(answer), ctypes.byref(decided))
+        finally:
+            self._candidates_free(handle)
+        if status == self.NO_ANSWER:
+            return -1, decided.value
+        self._check(status, 'decide')
+        return answer.value, decided.value
+
+
+# Built by `make shared`
+NATIVE_LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'build', 'libanalysis.so')
+
+# Set by use_native()
+native = None
+
+
+def use_native(path):
+    """Route encode, stream_diff, entropy and the removal search through the C++ core"""
+    global native, encode, stream_diff, entropy
+    native = NativeCore(path)
+    encode = native.encode
+    stream_diff = native.stream_diff
+    entropy = native.entropy
+
+
 def cipher_removed_at(ciphertext, i):
     return ciphertext[:i] + ciphertext[i+1:]
 
@@ -177,6 +315,29 @@ def remove_chars(ciphertext, indices, N):
     return ''.join(segments)
 
 
+def removal_entropies(diffs_cache, possible_indices, N, n_remove):
+    ents = np.zeros((len(possible_indices), ))
+    for i, indices in enumerate(possible_indices):
+        # reuse precomputed diffs
+        cursor = 0
+        diffs = [None] * N
+
+        diffs[:indices[0]] = diffs_cache[0][:indices[0]]
+        cursor = indices[0]
+        # diffs.extend(diffs_cache[0][:indices[0]])
+        for j, (start, stop) in enumerate(pairwise(indices)):
+            diffs[cursor:cursor + stop - start -1] = diffs_cache[j+1][start-j:stop-j-1]
+            cursor += stop - start - 1
+            # diffs.extend(diffs_cache[j+1][start-j:stop-j-1])
+        diffs[cursor:] = diffs_cache[n_remove][indices[-1]-len(indices)+1:]
+        # diffs.extend(diffs_cache[n_remove][indices[-1]-len(indices)+1:])
+        diffs = np.array(diffs, dtype=int)
+
+        ent = entropy(diffs)
+        ents[i] = ent
+    return ents
+
+
 def remove_many_chars_with_fft_test(ciphertext, plaintext, N=48, n_range=range(2, 5), std_multiplier=3):
     plain_stream = encode(plaintext[:N])
     cipher_stream = encode(ciphertext[:N + 4])
@@ -191,26 +352,12 @@ def remove_many_chars_with_fft_test(ciphertext, plaintext, N=48, n_range=range(2
 
     for n_remove in n_range:
         possible_indices = list(combinations(range(N), n_remove))
-        ents = np.zeros((len(possible_indices), ))
-        for i, indices in enumerate(possible_indices):
-            # reuse precomputed diffs
-            cursor = 0
-            diffs = [None] * N
-
-            diffs[:indices[0]] = diffs_cache[0][:indices[0]]
-            cursor = indices[0]
-            # diffs.extend(diffs_cache[0][:indices[0]])
-            for j, (start, stop) in enumerate(pairwise(indices)):
-                diffs[cursor:cursor + stop - start -1] = diffs_cache[j+1][start-j:stop-j-1]
-                cursor += stop - start - 1
-                # diffs.extend(diffs_cache[j+1][start-j:stop-j-1])
-            diffs[cursor:] = diffs_cache[n_remove][indices[-1]-len(indices)+1:]
-            # diffs.extend(diffs_cache[n_remove][indices[-1]-len(indices)+1:])
-            diffs = np.array(diffs, dtype=int)
-
-            ent = entropy(diffs)
-            ents[i] = ent
-        
+        if native is not None:
+            ents = native.removal_entropies(
+                cipher_stream, plain_stream, N, np.array(possible_indices, dtype=np.int64))
+        else:
+            ents = removal_entropies(diffs_cache, possible_indices, N, n_remove)
+
         ent_avg = ents.mean()
         ent_std = ents.std()
 
@@ -285,15 +432,30 @@ if __name__ == "__main__":
 
     parser = argparse.ArgumentParser()
     parser.add_argument('--profile', action='store_true', default=False)
+    parser.add_argument('--native', nargs='?', metavar='LIB', default=None, const=NATIVE_LIB,
+                        help='route the hot paths through the C++ core (make shared)')
+    parser.add_argument('--native-decide', action='store_true', default=False,
+                        help='decide with EntropyAnalysis::run of the C++ core (implies --native)')
+    parser.add_argument('--search-space', type=int, default=0,
+                        help='search space of --native-decide; 0 grows it as needed')
     args = parser.parse_args()
 
+    if args.native_decide and args.native is None:
+        args.native = NATIVE_LIB
+    if args.native is not None:
+        use_native(args.native)
+
     if args.profile:
         profiler = cProfile.Profile()
 
 
     if args.profile:
         profiler.enable()
-    guess, reason = decrypt(ciphertext)
+    if args.native_decide:
+        guess, search_space = native.decide(ciphertext, plains, args.search_space)
+        reason = f'native decision at search space {search_space}'
+    else:
+        guess, reason = decrypt(ciphertext)
 
     if args.profile:
         profiler.disable()
@@ -4,10 +4,10 @@ import random
 
 COIN_THRESHOLD = 0.05
 
-ctoi = { ' ': 0 }
+# Space is 0, 'a'..'z' are 1..26, as DefaultAlphabet in include/alphabet.h
+ALPHABET = ' ' + string.ascii_lowercase
 
-for c in string.ascii_lowercase:
-  ctoi[c] = ord(c) - ord('a') + 1
+ctoi = { c: i for i, c in enumerate(ALPHABET) }
 
 itoc = { i:c for c,i in ctoi.items() }
 
@@ -19,7 +19,7 @@ def construct_key(key: str) -> list[int]:
   """
   keys = key.split()
   for k in keys:
-    assert 0 <= int(k) <= 26
+    assert 0 <= int(k) < len(ALPHABET)
   return [int(k) for k in keys]
 
 
@@ -39,10 +39,10 @@ def encrypt(msg: list[int], key: list[int]) -> str:
 
     if coin >= COIN_THRESHOLD:
       j = (msg_ptr + 1) % len(key)
-      cipher.append((msg[msg_ptr] + key[j]) % 27)
+      cipher.append((msg[msg_ptr] + key[j]) % len(ALPHABET))
       msg_ptr += 1
     else:
-      c = random.randint(0, 26)
+      c = random.randint(0, len(ALPHABET) - 1)
       cipher.append(c)
       rand_idx.append(cipher_ptr)
     cipher_ptr += 1
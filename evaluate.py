@@ -23,9 +23,11 @@ for file in sorted(files):
         filename = os.path.basename(file).split('.')[0]
         keylen, correct = filename.split('_')
         keylen = int(keylen)
-        expand = int(expand)
-        if expand < 6:
-            continue
+        # results/auto holds the runs of the adaptive search space
+        if expand != 'auto':
+            expand = int(expand)
+            if expand < 6:
+                continue
         answer = f.readlines()[-1].strip().split(' ')[-1]
         if answer == correct:
             results[expand][keylen][correct] = True
@@ -33,8 +35,9 @@ for file in sorted(files):
             results[expand][keylen][correct] = False
 
 
-for expand, result in sorted(results.items(), key=lambda x: x[0]):
-    if search_space is not None and expand != int(search_space):
+for expand, result in sorted(results.items(),
+                             key=lambda x: (isinstance(x[0], str), x[0])):
+    if search_space is not None and str(expand) != search_space:
         continue
     print('Search Space =', expand)
     table = PrettyTable()
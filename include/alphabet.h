@@ -0,0 +1,133 @@
+#ifndef ALPHABET_H__
+#define ALPHABET_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// Alphabet policies. A policy names the symbols of a cipher: kSize, and the
+/// mapping between characters and symbols 0..kSize-1. It is only evaluated
+/// at compile time, by Alphabet, which turns it into lookup tables.
+
+/// @brief The alphabet of the assignment: space is 0, 'a'..'z' are 1..26
+struct SpaceLetters {
+  static constexpr std::size_t kSize = 27;
+  static constexpr int symbol(unsigned char c) {
+    if (c == ' ') {
+      return 0;
+    }
+    return ('a' <= c && c <= 'z') ? c - 'a' + 1 : -1;
+  }
+  static constexpr char character(int s) {
+    return s == 0 ? ' ' : (char)('a' + s - 1);
+  }
+};
+
+/// @brief 'a'..'z' as 0..25, the classical Vigenere alphabet
+struct Letters {
+  static constexpr std::size_t kSize = 26;
+  static constexpr int symbol(unsigned char c) {
+    return ('a' <= c && c <= 'z') ? c - 'a' : -1;
+  }
+  static constexpr char character(int s) { return (char)('a' + s); }
+};
+
+/// @brief Every byte is its own symbol
+struct Bytes {
+  static constexpr std::size_t kSize = 256;
+  static constexpr int symbol(unsigned char c) { return c; }
+  static constexpr char character(int s) { return (char)s; }
+};
+
+/// @brief Symbol mapping and modular arithmetic of an alphabet policy, from
+/// tables built at compile time.
+///
+/// Every operation is a table lookup or, for power-of-two alphabets, a mask:
+/// there is no branch left for the inner loops that use them.
+template <typename Policy>
+class Alphabet {
+ public:
+  static constexpr std::size_t kSize = Policy::kSize;
+  static_assert(kSize >= 2 && kSize <= 256, "Symbols must fit in a byte");
+
+ private:
+  static constexpr bool kPowerOfTwo = (kSize & (kSize - 1)) == 0;
+
+  static constexpr std::array<std::int16_t, 256> make_symbols() {
+    std::array<std::int16_t, 256> symbols{};
+    for (std::size_t c = 0; c < 256; c++) {
+      symbols[c] = Policy::symbol((unsigned char)c);
+    }
+    return symbols;
+  }
+
+  static constexpr std::array<char, kSize> make_characters() {
+    std::array<char, kSize> characters{};
+    for (std::size_t s = 0; s < kSize; s++) {
+      characters[s] = Policy::character(s);
+    }
+    return characters;
+  }
+
+  // Power-of-two alphabets wrap with a mask and need no table
+  static constexpr std::size_t kDiffTableSize = kPowerOfTwo ? 1 : kSize * kSize;
+
+  static constexpr std::array<std::uint8_t, kDiffTableSize> make_diffs() {
+    std::array<std::uint8_t, kDiffTableSize> diffs{};
+    if (!kPowerOfTwo) {
+      for (std::size_t c = 0; c < kSize; c++) {
+        for (std::size_t p = 0; p < kSize; p++) {
+          diffs[c * kSize + p] = (c + kSize - p) % kSize;
+        }
+      }
+    }
+    return diffs;
+  }
+
+  static constexpr std::array<std::int16_t, 256> kSymbols = make_symbols();
+  static constexpr std::array<char, kSize> kCharacters = make_characters();
+  static constexpr std::array<std::uint8_t, kDiffTableSize> kDiffs =
+      make_diffs();
+
+ public:
+  // Symbol of character c, or -1 if c is not in the alphabet
+  static constexpr int symbol(char c) { return kSymbols[(unsigned char)c]; }
+
+  static constexpr bool contains(char c) { return symbol(c) >= 0; }
+
+  // Whether every character of `text` is in the alphabet. Input from outside
+  // the program is checked with it before any symbol lookup.
+  static bool contains_all(std::string_view text) {
+    for (char c : text) {
+      if (!contains(c)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static constexpr char character(int s) { return kCharacters[s]; }
+
+  // (c - p) mod kSize, for symbols c and p
+  static constexpr int diff(int c, int p) {
+    if constexpr (kPowerOfTwo) {
+      return (c - p) & (int)(kSize - 1);
+    } else {
+      return kDiffs[c * kSize + p];
+    }
+  }
+
+  // (s + amount) mod kSize, for a symbol s and any amount
+  static constexpr int shift(int s, int amount) {
+    return (s + amount % (int)kSize + (int)kSize) % (int)kSize;
+  }
+};
+
+/// @brief The alphabet of the ciphertexts and plaintexts of this project;
+/// the packed diff kernels (packed.h) are specialized for it
+using DefaultAlphabet = Alphabet<SpaceLetters>;
+
+static constexpr std::size_t kAlphabetSize = DefaultAlphabet::kSize;
+
+#endif  // ALPHABET_H__
@@ -0,0 +1,57 @@
+#ifndef BATCH_H__
+#define BATCH_H__
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+#include "thread_pool.h"
+
+class BatchAnalysis {
+ private:
+  /// @brief Encoded once and shared by every analysis
+  const std::shared_ptr<const CandidateStreams> candidates;
+  const std::size_t search_space;
+
+  ThreadPool pool;
+
+  /// @brief Inputs submitted to the pool but not written out yet, oldest
+  /// first. Bounded, so that a long input stream is never fully buffered.
+  std::deque<std::pair<std::string, std::future<std::optional<std::size_t>>>>
+      pending;
+  std::size_t max_pending;
+
+  // Shortest ciphertext the analysis can handle
+  std::size_t min_length;
+
+  std::size_t n_done = 0;
+
+  /// @brief Where metrics dumps requested during the run go
+  std::ostream *metrics_out;
+
+  void submit(std::string name, std::string ciphertext, std::ostream &out);
+  void write_front(std::ostream &out);
+
+ public:
+  BatchAnalysis(std::shared_ptr<const CandidateStreams> candidates,
+                std::size_t search_space, std::size_t n_workers);
+
+  // Write the metrics to `out` whenever request_metrics_dump() was called,
+  // between two ciphertexts; std::cerr by default
+  void dump_metrics_to(std::ostream *out) { metrics_out = out; }
+
+  // Analyze every ciphertext of `source` and write one "<name> <answer>" line
+  // per input to `out`, in input order. `source` is a directory (every
+  // regular file in it, sorted by name), a glob pattern, a single file, or
+  // "-" for newline-delimited ciphertexts on stdin.
+  // Returns the number of inputs analyzed.
+  std::size_t run(const std::string &source, std::ostream &out);
+};
+
+#endif  // BATCH_H__
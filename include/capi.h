@@ -0,0 +1,105 @@
+#ifndef CAPI_H__
+#define CAPI_H__
+
+/* C ABI of the analysis core, built as build/libanalysis.so (make shared).
+ *
+ * Every buffer belongs to the caller: the library reads its inputs and
+ * writes its outputs in place, and keeps no pointer past the call, except
+ * for the candidate rows of analysis_candidates_view(). A numpy array
+ * passed through ctypes is used as is, without a copy, as long as it is
+ * C-contiguous and of the documented element type.
+ *
+ * Symbols are those of the ciphertexts: 0 for a space, 1..26 for a..z.
+ * Functions return ANALYSIS_OK or a negative analysis_status, and never
+ * throw. Only the functions below are exported, and their signatures only
+ * change along with ANALYSIS_ABI_VERSION. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ANALYSIS_API __attribute__((visibility("default")))
+
+#define ANALYSIS_ABI_VERSION 1
+
+typedef enum {
+  ANALYSIS_OK = 0,
+  /* The analysis found no plaintext */
+  ANALYSIS_NO_ANSWER = -1,
+  /* A character or symbol outside the alphabet, a buffer too short for the
+     request, or removal positions out of order */
+  ANALYSIS_INVALID_INPUT = -2,
+  /* Out of memory, or a dictionary that cannot be loaded */
+  ANALYSIS_FAILURE = -3
+} analysis_status;
+
+/* Candidate plaintexts of the full analysis */
+typedef struct analysis_candidates analysis_candidates;
+
+/* ANALYSIS_ABI_VERSION of the library, to check against the header */
+ANALYSIS_API int analysis_abi_version(void);
+
+/* Encode text[0, length) into out[0, length) */
+ANALYSIS_API int analysis_encode(const char *text, size_t length,
+                                 uint8_t *out);
+
+/* out[i] = (a[i] - b[i]) mod 27 for i < length */
+ANALYSIS_API int analysis_diff(const uint8_t *a, const uint8_t *b,
+                               size_t length, uint8_t *out);
+
+/* Shannon entropy, in nats, of the symbols of symbols[0, length) into
+   *entropy; 0 if length is 0 */
+ANALYSIS_API int analysis_entropy(const uint8_t *symbols, size_t length,
+                                  double *entropy);
+
+/* Entropies of the diffs between plain[0, length) and the cipher with
+   removal sets taken out, as remove_many_chars_with_fft_test in
+   decryption.py scores them.
+
+   removal_sets holds n_sets rows of n_remove positions of the cipher, each
+   row strictly increasing; cipher holds at least length + n_remove symbols.
+   entropies[s] receives the entropy of the first length diffs without the
+   positions of row s. */
+ANALYSIS_API int analysis_removal_entropies(
+    const uint8_t *cipher, size_t cipher_length, const uint8_t *plain,
+    size_t length, const int64_t *removal_sets, size_t n_sets,
+    size_t n_remove, double *entropies);
+
+/* Candidates from n_candidates rows of `stride` symbols at `rows`, where row
+   p holds lengths[p] <= stride symbols. Nothing is copied: both buffers must
+   outlive the candidates. Returns NULL on invalid input. */
+ANALYSIS_API analysis_candidates *analysis_candidates_view(
+    const uint8_t *rows, const uint64_t *lengths, size_t n_candidates,
+    size_t stride);
+
+/* Candidates mapped from a dictionary compiled by dictc; NULL, with a
+   message on stderr, if it cannot be loaded */
+ANALYSIS_API analysis_candidates *analysis_candidates_open(const char *path);
+
+ANALYSIS_API void analysis_candidates_free(analysis_candidates *candidates);
+
+/* Number of candidates, and symbols of the shortest one */
+ANALYSIS_API size_t analysis_candidates_size(
+    const analysis_candidates *candidates);
+ANALYSIS_API size_t analysis_candidates_length(
+    const analysis_candidates *candidates);
+
+/* The decision of EntropyAnalysis::run on ciphertext[0, length): the index
+   of the candidate into *answer. search_space 0 runs the adaptive mode; if
+   decided_search_space is not NULL, it receives the search space that
+   decided. The ciphertext holds at least 3 * search_space characters and as
+   many as the longest candidate. Runs in the calling thread, and may run
+   concurrently on the same candidates. */
+ANALYSIS_API int analysis_decide(const analysis_candidates *candidates,
+                                 const char *ciphertext, size_t length,
+                                 size_t search_space, size_t *answer,
+                                 size_t *decided_search_space);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPI_H__ */
@@ -0,0 +1,45 @@
+#ifndef COINCIDENCE_H__
+#define COINCIDENCE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/// @brief Key length estimation from the index of coincidence of the columns
+/// of the ciphertext, for every candidate period.
+///
+/// Symbols enciphered with the same key character coincide as often as the
+/// plaintext symbols do, while unrelated symbols coincide with probability
+/// 1/27. Random insertions shift the column of every later symbol, so only
+/// consecutive entries of a column are compared: the pairs (i, i + t) of
+/// period t. A pair then survives unless an insertion falls between its two
+/// symbols.
+class CoincidenceAnalysis {
+ private:
+  /// @brief The encoded ciphertext, one byte per symbol
+  std::vector<std::uint8_t> symbols;
+
+  /// @brief Coincidence rate of every period, as (period => rate) pairs
+  std::vector<std::pair<std::size_t, double>> rates;
+
+  /// @brief Number of i such that symbols[i] == symbols[i + shift]
+  std::size_t count_matches(std::size_t shift) const;
+
+ public:
+  static constexpr std::size_t kMinPeriod = 3;
+  static constexpr std::size_t kMaxPeriod = 24;
+
+  explicit CoincidenceAnalysis(const std::string &ciphertext);
+
+  // Rank the periods by coincidence rate, and return the three most likely
+  // key lengths like KasiskiAnalysis::run
+  std::vector<std::size_t> run();
+
+  // Every period, most likely first, once run() has ranked them
+  std::vector<std::size_t> ranking() const;
+};
+
+#endif  // COINCIDENCE_H__
@@ -2,29 +2,151 @@
 #define COMMON_H__
 
 // Common functions
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
-int diff(int c, int p);
-int ctoi(char c);
+#include "alphabet.h"
+
+typedef std::vector<int> Encoded;
+
+// Shorthands for DefaultAlphabet
+inline int diff(int c, int p) { return DefaultAlphabet::diff(c, p); }
+
+// Symbol of c, which must be in the alphabet
+inline int ctoi(char c) {
+  assert(DefaultAlphabet::contains(c));
+  return DefaultAlphabet::symbol(c);
+}
+
+// `line` without the '\r' that std::getline leaves of a CRLF line ending
+std::string strip_line_end(std::string line);
+
+// The characters of `text` in DefaultAlphabet, in order
+std::string alphabet_only(std::string_view text);
+
 bool sortByVal(const std::pair<std::size_t, double> &a,
                const std::pair<std::size_t, double> &b);
+
+// The character `amount` symbols after m, as a key symbol encrypts it
 char forward(char m, int amount);
 
+// Shorten a key that repeats with a smaller period to that period: a multiple
+// of the key length also decrypts, with a repeated key
+void reduce_key_period(std::vector<int> &key);
+
+/// @brief k-combinations of {0, ..., n-1} in lexicographic order, without
+/// allocating per combination.
+///
+/// next() returns a pointer to the k indices of the next combination, which
+/// stays valid until the following call, or nullptr once all are visited:
+///
+///   for (auto c = comb.next(); c != nullptr; c = comb.next()) { ... c[i] ... }
+///
+/// Counts are 64 bit. Every combination has a lexicographic rank in
+/// [0, C(n, k)), and a generator can be restricted to a range of ranks, so a
+/// space splits into independent chunks (see chunk()) for worker threads, or
+/// resumes from a saved rank.
 class Combination {
  private:
   std::size_t n, k;
   std::vector<std::size_t> state;
-  int end;
-  int current = 0;
-  int round = 0;
+  std::uint64_t first, end;
+  std::uint64_t current;
 
  public:
   Combination(std::size_t n, std::size_t k);
-  std::optional<std::vector<std::size_t>> next();
 
-  std::size_t size() { return end; }
+  // Only the combinations of rank [first, end)
+  Combination(std::size_t n, std::size_t k, std::uint64_t first,
+              std::uint64_t end);
+
+  const std::size_t *next() {
+    if (current == end) {
+      return nullptr;
+    }
+    if (current++ != first) {
+      step(n, k, state.data());
+    }
+    return state.data();
+  }
+
+  // Number of combinations this generator visits
+  std::uint64_t size() const { return end - first; }
+
+  // Rank of the combination next() returned last
+  std::uint64_t rank() const { return current - 1; }
+
+  // C(n, k); asserts that it fits in 64 bits
+  static std::uint64_t binomial(std::size_t n, std::size_t k);
+
+  // Lexicographic rank of the sorted combination c[0..k)
+  static std::uint64_t rank(std::size_t n, std::size_t k,
+                            const std::size_t *c);
+
+  // The combination of lexicographic rank `r`, into out[0..k)
+  static void unrank(std::size_t n, std::size_t k, std::uint64_t r,
+                     std::size_t *out);
+
+  // Advance c[0..k) to the next combination in lexicographic order
+  static void step(std::size_t n, std::size_t k, std::size_t *c) {
+    std::size_t i = k - 1;
+    while (i > 0 && c[i] == n - k + i) {
+      i--;
+    }
+    c[i]++;
+    for (std::size_t j = i + 1; j < k; j++) {
+      c[j] = c[j - 1] + 1;
+    }
+  }
+
+  // Rank range [first, end) of chunk i out of n_chunks near-equal chunks of
+  // `total` combinations
+  static std::pair<std::uint64_t, std::uint64_t> chunk(std::uint64_t total,
+                                                       std::size_t n_chunks,
+                                                       std::size_t i);
+};
+
+/// @brief Combination with k fixed at compile time, keeping its state in a
+/// std::array (e.g. the removal prefixes of RemovalSetSearch::below).
+template <std::size_t K>
+class FixedCombination {
+ private:
+  std::size_t n;
+  std::array<std::size_t, K> state;
+  std::uint64_t first, end;
+  std::uint64_t current;
+
+ public:
+  explicit FixedCombination(std::size_t n)
+      : FixedCombination(n, 0, Combination::binomial(n, K)) {}
+
+  FixedCombination(std::size_t n, std::uint64_t first, std::uint64_t end)
+      : n(n), first(first), end(end), current(first) {
+    static_assert(K > 0, "FixedCombination needs K > 0");
+    if (first < end) {
+      Combination::unrank(n, K, first, state.data());
+    }
+  }
+
+  const std::array<std::size_t, K> *next() {
+    if (current == end) {
+      return nullptr;
+    }
+    if (current++ != first) {
+      Combination::step(n, K, state.data());
+    }
+    return &state;
+  }
+
+  std::uint64_t size() const { return end - first; }
+  std::uint64_t rank() const { return current - 1; }
 };
 
 #endif  // COMMON_H__
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef DICTIONARY_H__
+#define DICTIONARY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+
+/// @brief Header of a compiled candidate dictionary.
+///
+/// A dictionary file holds the candidate plaintexts already encoded, in the
+/// layout of CandidateStreams, so that loading it is a single mmap: no
+/// parsing, no encoding, and the pages are shared by every process that maps
+/// the same file. All integers are native-endian; the file is meant for the
+/// machine that compiled it.
+///
+///   DictionaryHeader
+///   std::uint64_t lengths[n_candidates]      at lengths_offset
+///   n_candidates rows of `stride` symbols     at rows_offset
+///
+/// Both sections start on a kDictionaryAlignment boundary, and so does every
+/// row. Row p holds the lengths[p] symbols of candidate p, zero padded.
+struct DictionaryHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t n_candidates;
+  std::uint64_t stride;
+  std::uint64_t common_length;
+  std::uint64_t lengths_offset;
+  std::uint64_t rows_offset;
+};
+
+static constexpr char kDictionaryMagic[8] = {'C', 'A', 'N', 'D',
+                                             'D', 'I', 'C', 'T'};
+static constexpr std::uint32_t kDictionaryVersion = 1;
+static constexpr std::size_t kDictionaryAlignment = 64;
+
+// The candidate plaintexts of a corpus such as resources/plaintext1.txt: one
+// per line, skipping blank lines and "Test ..." / "Candidate ..." titles
+std::vector<std::string> read_corpus(const std::string &path);
+
+// Write `candidates` to a dictionary file at `path`. Returns false, with a
+// message on stderr, if a candidate has a character outside the alphabet or
+// the file cannot be written.
+bool compile_dictionary(const std::vector<std::string> &candidates,
+                        const std::string &path);
+
+// Map the dictionary file at `path`, in O(1) of its size. The candidates keep
+// the mapping alive. Returns nullptr, with a message on stderr, if the file
+// is missing, truncated, or not a dictionary of this version.
+std::shared_ptr<const CandidateStreams> load_dictionary(
+    const std::string &path);
+
+#endif  // DICTIONARY_H__
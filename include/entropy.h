@@ -1,75 +1,201 @@
 #ifndef ENTROPY_H__
 #define ENTROPY_H__
 
+#include <cassert>
+#include <functional>
 #include <iomanip>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "common.h"
-
-typedef std::vector<int> Encoded;
-
-Encoded encode(const std::string &text);
+#include "entropy_counter.h"
+#include "packed.h"
+#include "thread_pool.h"
+
+// Symbols of `text` in alphabet A, which must hold all of it (see
+// Alphabet::contains_all)
+template <typename A>
+Encoded encode_as(const std::string &text) {
+  Encoded encoded;
+  encoded.reserve(text.length());
+  for (char c : text) {
+    assert(A::contains(c));
+    encoded.push_back(A::symbol(c));
+  }
+  return encoded;
+}
+
+inline Encoded encode(const std::string &text) {
+  return encode_as<DefaultAlphabet>(text);
+}
 
 void print_encoded(const Encoded &encoded, std::size_t to);
 
-typedef std::map<int, int> Counter;
-
+// The candidate plaintexts, encoded and packed once so that any number of
+// analyses can share them
+std::shared_ptr<const CandidateStreams> encode_candidates(
+    const std::vector<std::string> &plaintexts);
+
+typedef EntropyCounter Counter;
+
+/// @brief Compares the entropy trends of the diffs against every candidate
+/// plaintext, to find the one whose trend stands out.
+///
+/// The trends are rows of one contiguous matrix. Up to kMaxPairwiseTrends
+/// candidates, every pair of trends is compared and each distant pair votes
+/// for its lower trend. With more candidates the O(N^2 * L) pairs are too
+/// many, and each trend is compared with the median trend instead, which
+/// costs O(N * L).
 class TrendsComparison {
  private:
-  const std::vector<std::vector<float>> trends;
+  const std::size_t n_trends;
+  const std::size_t length;
+
+  /// @brief n_trends x length matrix, one trend per row
+  const std::vector<float> trends;
 
+  /// @brief Pairwise mode: squared distances of all pairs i < j, in
+  /// lexicographic order. Median mode: squared distance of every trend from
+  /// the median trend.
   std::vector<float> diff_measures;
 
+  /// @brief Signed counterpart of diff_measures. Pairwise mode: sum of
+  /// (trend i - trend j) of every pair, whose sign tells the lower trend of
+  /// the pair. Median mode: sum of (trend - median trend) of every trend,
+  /// whose sign tells trends below the median from those above it.
+  std::vector<float> offsets;
+
   float avg;
   float std_dev;
 
   float std_dev_threshold;
 
+  /// @brief How clearly the last anomaly detected stands out, in [0, 1]
+  float margin = 0.0f;
+
+  const float *trend(std::size_t p) const {
+    return trends.data() + p * length;
+  }
+
+  bool pairwise() const { return n_trends <= kMaxPairwiseTrends; }
+
+  void measure_pairs();
+  void measure_median_distances();
+  void measure_stats();
+
+  std::optional<size_t> detect_pair_anomaly();
+  std::optional<size_t> detect_median_anomaly();
+
  public:
-  TrendsComparison(std::vector<std::vector<float>> trends,
+  static constexpr std::size_t kMaxPairwiseTrends = 64;
+
+  // `trends` holds n_trends trends of equal length, one after another
+  TrendsComparison(std::vector<float> trends, std::size_t n_trends,
                    float std_dev_threshold);
+
+  // From diff_measures and offsets accumulated elsewhere, as described
+  // above, e.g. symbol by symbol by OnlineAnalysis
+  TrendsComparison(std::size_t n_trends, std::vector<float> diff_measures,
+                   std::vector<float> offsets, float std_dev_threshold);
+
   std::optional<size_t> detect_anomaly();
 
   float get_std_dev() { return std_dev; }
+
+  // Pairwise mode: share of the other trends the anomaly got a vote against.
+  // Median mode: 1 - (distance of the runner-up / distance of the anomaly).
+  float get_margin() const { return margin; }
 };
 
 class EntropyAnalysis {
+  // tools/bench.cpp times the private stages one by one
+  friend class EntropyBenchmark;
+
  private:
   const std::string ciphertext;
   Encoded cipher_stream;
 
-  const std::vector<std::string> plaintexts;
-  std::vector<Encoded> plain_streams;
+  /// @brief The plaintext streams, packed side by side for the diff kernels,
+  /// possibly shared with other analyses or mapped from a dictionary file
+  std::shared_ptr<const CandidateStreams> candidates;
 
+  /// @brief In adaptive mode, the largest search space the first pass may
+  /// grow to: a third of the ciphertext or of the shortest candidate
   const std::size_t search_space;
+  const bool adaptive;
 
-  std::vector<Encoded> measure_diffs(const Encoded &cipher_stream);
+  /// @brief Search space that decided the last run()
+  std::size_t decided_search_space = 0;
 
-  float compute_entropy(const Counter &counter);
+  /// @brief Pool running the removal search in parallel; serial if null.
+  ThreadPool *pool = nullptr;
 
-  Counter make_counter(Encoded::iterator begin, Encoded::iterator end);
+  // Diffs of the first `length` characters of the given cipherstream against
+  // every plainstream; the diffs against plaintext p start at p * length
+  std::vector<std::uint8_t> measure_diffs(const Encoded &cipher_stream,
+                                          std::size_t length);
 
-  std::vector<float> compute_entropy_trend(Encoded::iterator begin,
-                                           Encoded::iterator end, int start);
+  float compute_entropy(const Counter &counter);
 
-  std::string char_removed_at(const std::string &s, size_t i);
+  Counter make_counter(const std::uint8_t *begin, const std::uint8_t *end);
 
-  std::string optimize_entropy_for(const std::string &plaintext,
-                                   std::size_t expected_randoms);
+  // Entropy of the diffs [begin, begin + start + i) for
+  // i < end - begin - start, into trend[i]
+  void compute_entropy_trend(const std::uint8_t *begin, const std::uint8_t *end,
+                             int start, float *trend);
+
+  // Look for 2 or more random characters among the first characters of the
+  // ciphertext, whose removal makes the diffs against a plaintext periodic
+  std::optional<std::size_t> search_removal_sets();
 
   std::shared_ptr<TrendsComparison> entropy_trend_analysis(
       const Encoded &cipher_stream, std::size_t trend_start,
       float std_dev_threshold);
 
+  // The first pass at search spaces kMinSearchSpace, twice that, and so on up
+  // to search_space, until one of them finds an anomaly. Every window extends
+  // the entropies of the smaller ones instead of recomputing them.
+  std::optional<std::size_t> adaptive_first_pass();
+
  public:
-  EntropyAnalysis(std::string ciphertext, std::vector<std::string> plaintexts,
+  /// @brief Pass as the search space to grow it as needed (adaptive mode)
+  static constexpr std::size_t kAdaptive = 0;
+
+  /// @brief First search space of the adaptive mode
+  static constexpr std::size_t kMinSearchSpace = 60;
+
+  EntropyAnalysis(std::string ciphertext,
+                  const std::vector<std::string> &plaintexts,
+                  std::size_t search_space);
+
+  // The candidates must be at least search_space symbols long
+  EntropyAnalysis(std::string ciphertext,
+                  std::shared_ptr<const CandidateStreams> candidates,
                   std::size_t search_space);
+
+  void use_thread_pool(ThreadPool *pool) { this->pool = pool; }
+
   std::optional<std::size_t> run();
+
+  // Shortest ciphertext an analysis at `search_space` can handle: it compares
+  // the ciphertext against every candidate position
+  static std::size_t min_length(const CandidateStreams &candidates,
+                                std::size_t search_space);
+
+  // Whether `ciphertext` is at least `min_length` long and in the alphabet,
+  // so that an analysis can run on it; the check of every external input
+  static bool analyzable(std::string_view ciphertext, std::size_t min_length) {
+    return ciphertext.size() >= min_length &&
+           DefaultAlphabet::contains_all(ciphertext);
+  }
+
+  // Search space that decided the last run(): the window of the first pass
+  // that found an anomaly, or else the window of the removal search
+  std::size_t get_search_space() const { return decided_search_space; }
 };
 
 #endif  // ENTROPY_H__
\ No newline at end of file
@@ -0,0 +1,118 @@
+#ifndef ENTROPY_COUNTER_H__
+#define ENTROPY_COUNTER_H__
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "alphabet.h"
+
+/// @brief Fixed-point c*log(c) terms shared by the entropy counters of every
+/// alphabet
+class EntropyTerms {
+ protected:
+  static constexpr double kScale = (double)(1 << 24);
+  static constexpr int kTableSize = 1 << 14;
+  static const std::vector<int64_t> clogc_table;
+
+  // c * log(c) in fixed point; counts past the table are computed directly
+  static int64_t clogc(int c) {
+    if (c < kTableSize) {
+      return clogc_table[c];
+    }
+    return clogc_slow(c);
+  }
+  static int64_t clogc_slow(int c);
+  static std::vector<int64_t> build_table();
+};
+
+/// @brief Incremental Shannon entropy over the symbols of alphabet A.
+///
+/// Keeps a flat histogram together with the running sum of c*log(c) over all
+/// bins, so that adding or removing a symbol and reading the entropy are O(1).
+/// The c*log(c) terms come from a precomputed table in fixed point: sums are
+/// exact integers, and two counters with equal histograms always report the
+/// same entropy regardless of the order the symbols were added in.
+template <typename A>
+class BasicEntropyCounter : EntropyTerms {
+ public:
+  static constexpr std::size_t kBins = A::kSize;
+
+  BasicEntropyCounter() { clear(); }
+
+  void clear() {
+    bins.fill(0);
+    n = 0;
+    clogc_sum = 0;
+  }
+
+  // Replace the contents with a histogram of kBins counts
+  void assign(const std::uint32_t *counts) {
+    n = 0;
+    clogc_sum = 0;
+    for (std::size_t b = 0; b < kBins; b++) {
+      bins[b] = counts[b];
+      n += counts[b];
+      clogc_sum += clogc(counts[b]);
+    }
+  }
+
+  void add(int symbol) {
+    int &c = bins[symbol];
+    clogc_sum += clogc(c + 1) - clogc(c);
+    c++;
+    n++;
+  }
+
+  void remove(int symbol) {
+    int &c = bins[symbol];
+    clogc_sum -= clogc(c) - clogc(c - 1);
+    c--;
+    n--;
+  }
+
+  // H = log(n) - sum(c * log(c)) / n
+  float entropy() const {
+    if (n == 0) {
+      return 0.0f;
+    }
+    return (float)((double)(clogc(n) - clogc_sum) / (kScale * (double)n));
+  }
+
+  // Entropy once `extra` more `symbol`s are added, leaving the counter as is
+  float entropy_with(int symbol, int extra) const {
+    int c = bins[symbol];
+    int n2 = n + extra;
+    if (n2 == 0) {
+      return 0.0f;
+    }
+    int64_t sum = clogc_sum - clogc(c) + clogc(c + extra);
+    return (float)((double)(clogc(n2) - sum) / (kScale * (double)n2));
+  }
+
+  int count(int symbol) const { return bins[symbol]; }
+  int total() const { return n; }
+
+ private:
+  std::array<int, kBins> bins;
+  int n;
+  int64_t clogc_sum;
+};
+
+typedef BasicEntropyCounter<DefaultAlphabet> EntropyCounter;
+
+// Continue the entropy trend of a counter that holds the symbols before
+// `begin`: trend[0] is its entropy, and trend[i] the entropy once the
+// symbols [begin, begin + i) are added too, for i < end - begin
+template <typename A>
+void extend_entropy_trend(BasicEntropyCounter<A> &counter,
+                          const std::uint8_t *begin, const std::uint8_t *end,
+                          float *trend) {
+  *trend++ = counter.entropy();
+  for (auto it = begin; it != end - 1; it++) {
+    counter.add(*it);
+    *trend++ = counter.entropy();
+  }
+}
+
+#endif  // ENTROPY_COUNTER_H__
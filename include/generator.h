@@ -0,0 +1,48 @@
+#ifndef GENERATOR_H__
+#define GENERATOR_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/// @brief A ciphertext with the random characters inserted into it
+struct GeneratedCipher {
+  std::string ciphertext;
+
+  /// @brief Positions of the random characters in the ciphertext
+  std::vector<std::size_t> random_indices;
+};
+
+/// @brief Seeded port of the encryption of enc.py, to generate test cases in
+/// memory.
+///
+/// Before every ciphertext character a coin is flipped: below
+/// kCoinThreshold, the character is a uniformly random symbol; otherwise it
+/// is the next plaintext character j shifted by key[(j + 1) % t]. The
+/// ciphertext ends with the last plaintext character. A generator is a
+/// deterministic function of its (seed, stream) pair, so case i of a run can
+/// be generated on any thread from stream i.
+class CipherGenerator {
+ private:
+  std::mt19937_64 rng;
+
+ public:
+  static constexpr double kCoinThreshold = 0.05;
+
+  explicit CipherGenerator(std::uint64_t seed, std::uint64_t stream = 0);
+
+  // Uniform shifts in [0, 26]
+  std::vector<int> random_key(std::size_t key_length);
+
+  GeneratedCipher encrypt(const std::string &plaintext,
+                          const std::vector<int> &key);
+
+  // Uniform in [0, n)
+  std::size_t uniform(std::size_t n);
+};
+
+#endif  // GENERATOR_H__
@@ -0,0 +1,149 @@
+#ifndef METRICS_H__
+#define METRICS_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+
+/// @brief Lock-free latency histogram with HDR-style log-linear buckets.
+///
+/// Values below 2^kSubBits nanoseconds have a bucket each. Above, every power
+/// of two [2^m, 2^(m+1)) is split into 2^kSubBits equal buckets, so any value
+/// is known within 1 / 2^kSubBits of itself (6%) over the whole 64-bit range,
+/// in a fixed array of counters. Recording is a few relaxed atomic adds, and
+/// any thread may record while another one reads.
+class LatencyHistogram {
+ public:
+  static constexpr std::size_t kSubBits = 4;
+  static constexpr std::size_t kSubBuckets = 1 << kSubBits;
+  static constexpr std::size_t kBuckets = kSubBuckets * (64 - kSubBits + 1);
+
+  void record(std::uint64_t ns);
+
+  std::uint64_t count() const {
+    return total.load(std::memory_order_relaxed);
+  }
+
+  // Smallest bucket value with at least a fraction q of the records at or
+  // below it; 0 if empty
+  std::uint64_t percentile(double q) const;
+
+  // {"count": n, "min_ns": ..., "mean_ns": ..., "p50_ns": ..., ...}
+  void write_json(std::ostream &out) const;
+
+  void clear();
+
+  static std::size_t bucket(std::uint64_t ns);
+
+  // Middle of the range of `bucket`
+  static std::uint64_t bucket_value(std::size_t bucket);
+
+ private:
+  std::array<std::atomic<std::uint64_t>, kBuckets> counts{};
+  std::atomic<std::uint64_t> total{0};
+  std::atomic<std::uint64_t> sum{0};
+  std::atomic<std::uint64_t> min{UINT64_MAX};
+  std::atomic<std::uint64_t> max{0};
+};
+
+// Timed stages of the analyses
+enum class Stage {
+  kKasiskiRun,
+  kEntropyRun,
+  kFirstPass,
+  kColumnScoring,
+  kOptimize,
+  kRemovalSearch,
+  kServerRequest,
+  kCount
+};
+
+// The strategy of EntropyAnalysis::run that decided a ciphertext
+enum class Decision {
+  kFirstPass,
+  kColumnScore,
+  kOptimizeRound,
+  kRemovalSet,
+  kMaxStdDev,
+  kCount
+};
+
+/// @brief Process-wide counters and latency histograms of the analyses: one
+/// histogram per stage, and per decision path the latency of the whole
+/// EntropyAnalysis::run that took it. Optimize-loop decisions are also
+/// counted per n_random round, and adaptive analyses per search space that
+/// decided them.
+class Metrics {
+ public:
+  /// @brief Rounds counted one by one; later rounds share the last counter
+  static constexpr std::size_t kMaxRounds = 64;
+
+  void record_stage(Stage stage, std::uint64_t ns) {
+    stages[(std::size_t)stage].record(ns);
+  }
+
+  // `round` is the n_random round of a kOptimizeRound decision
+  void record_decision(Decision decision, std::uint64_t ns,
+                       std::size_t round = 0);
+
+  // The search space that decided an EntropyAnalysis::run in adaptive mode
+  void record_search_space(std::size_t search_space);
+
+  void write_json(std::ostream &out) const;
+
+  void clear();
+
+ private:
+  std::array<LatencyHistogram, (std::size_t)Stage::kCount> stages;
+  std::array<LatencyHistogram, (std::size_t)Decision::kCount> decisions;
+  std::array<std::atomic<std::uint64_t>, kMaxRounds + 1> rounds{};
+
+  /// @brief Once per analysis, so a lock costs nothing next to it
+  mutable std::mutex search_spaces_mutex;
+  std::map<std::size_t, std::uint64_t> search_spaces;
+};
+
+Metrics &metrics();
+
+// Ask for a dump of the metrics; async-signal-safe, e.g. from a SIGUSR1
+// handler. The batch loop polls for it between ciphertexts.
+void request_metrics_dump();
+
+// Whether a dump was requested since the last call
+bool take_metrics_dump_request();
+
+/// @brief Records the time from its construction to its destruction, or to
+/// stop(), into the histogram of a stage
+class StageTimer {
+ private:
+  Stage stage;
+  std::chrono::steady_clock::time_point start;
+  bool stopped = false;
+
+ public:
+  explicit StageTimer(Stage stage)
+      : stage(stage), start(std::chrono::steady_clock::now()) {}
+
+  ~StageTimer() { stop(); }
+
+  // Nanoseconds since construction
+  std::uint64_t elapsed_ns() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  void stop() {
+    if (!stopped) {
+      metrics().record_stage(stage, elapsed_ns());
+      stopped = true;
+    }
+  }
+};
+
+#endif  // METRICS_H__
@@ -0,0 +1,106 @@
+#ifndef PACKED_H__
+#define PACKED_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/// @brief Encoded stream with one byte per symbol, instead of the four bytes
+/// of an Encoded.
+typedef std::vector<std::uint8_t> PackedStream;
+
+/// @brief Symbol counts of a stream over DefaultAlphabet
+typedef std::array<std::uint32_t, kAlphabetSize> Histogram;
+
+PackedStream pack(const Encoded &stream);
+
+// Instruction sets the kernels below are compiled for. Each level is only
+// used when the CPU supports it; kScalar is always available and the others
+// give bit-identical results.
+enum class SimdLevel { kScalar, kSse2, kAvx2 };
+
+// Level in use: the best one the CPU supports unless set_simd_level lowered it
+SimdLevel simd_level();
+
+// Use `level`, or the best supported level below it; returns the level in use
+SimdLevel set_simd_level(SimdLevel level);
+
+const char *simd_level_name(SimdLevel level);
+
+// The level simd_level_name() calls `name`, if any
+std::optional<SimdLevel> parse_simd_level(const std::string &name);
+
+// out[i] = diff(cipher[i], plain[i]) for i < n
+void diff_streams(const std::uint8_t *cipher, const std::uint8_t *plain,
+                  std::uint8_t *out, std::size_t n);
+
+// Add the counts of the symbols of stream[0, n) to `histogram`
+void count_symbols(const std::uint8_t *stream, std::size_t n,
+                   Histogram &histogram);
+
+// Add the counts of diff(cipher[i], plain[i]) for i < n to `histogram`,
+// without storing the diffs
+void count_diffs(const std::uint8_t *cipher, const std::uint8_t *plain,
+                 std::size_t n, Histogram &histogram);
+
+/// @brief All candidate plaintexts in one structure-of-arrays block: row p
+/// starts at p * stride and holds candidate p. Every candidate is diffed
+/// against the same cipher window, up to the length of the shortest one.
+///
+/// The block is either owned, or a view of memory kept alive by an owner,
+/// such as a mapped dictionary file (see dictionary.h).
+class CandidateStreams {
+ private:
+  std::size_t n_candidates;
+  std::size_t stride;
+  std::size_t common_length;
+  const std::uint8_t *rows;
+  const std::uint64_t *lengths;
+
+  PackedStream owned_rows;
+  std::vector<std::uint64_t> owned_lengths;
+  std::shared_ptr<const void> owner;
+
+ public:
+  explicit CandidateStreams(const std::vector<Encoded> &candidates);
+
+  // View of n_candidates rows of `stride` bytes at `rows`, where candidate p
+  // has lengths[p] symbols and the shortest has common_length
+  CandidateStreams(const std::uint8_t *rows, const std::uint64_t *lengths,
+                   std::size_t n_candidates, std::size_t stride,
+                   std::size_t common_length,
+                   std::shared_ptr<const void> owner);
+
+  CandidateStreams(const CandidateStreams &) = delete;
+  CandidateStreams &operator=(const CandidateStreams &) = delete;
+
+  std::size_t size() const { return n_candidates; }
+
+  // Symbols of the shortest candidate
+  std::size_t length() const { return common_length; }
+
+  // Symbols of candidate p
+  std::size_t length(std::size_t p) const {
+    return std::min<std::size_t>(lengths[p], stride);
+  }
+
+  const std::uint8_t *row(std::size_t p) const { return rows + p * stride; }
+
+  // Diffs of cipher[0, n) against every candidate, into out[p * n + i]; out
+  // holds size() * n bytes and n <= length()
+  void diffs(const std::uint8_t *cipher, std::size_t n,
+             std::uint8_t *out) const;
+
+  // Histograms of the diffs of cipher[0, n) against every candidate, into
+  // out[p]; out holds size() histograms and n <= length()
+  void histograms(const std::uint8_t *cipher, std::size_t n,
+                  Histogram *out) const;
+};
+
+#endif  // PACKED_H__
@@ -0,0 +1,52 @@
+#ifndef PERIODICITY_H__
+#define PERIODICITY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+
+/// @brief Counts the DFT bins at zero of every prefix of a short integer
+/// stream, as the prefix grows one symbol at a time.
+///
+/// For a prefix of length M, bin k only depends on the residue sums
+///   S_d[r] = sum of x[j] for j < M, j = r (mod d),   with d = M / gcd(k, M)
+/// which are kept up to date for every d as symbols arrive. Besides, the
+/// stream is made of integers, so bin k is zero exactly when all the bins of
+/// the same d are (they are Galois conjugates): each divisor d of M needs a
+/// single O(d) evaluation instead of a transform per bin.
+class PeriodicityDetector {
+ private:
+  const std::size_t max_length;
+
+  /// @brief S_d[r] is sums[offset(d) + r], for d = 1..max_length
+  std::vector<int64_t> sums;
+
+  /// @brief Next residue mod d, for every d
+  std::vector<std::size_t> residues;
+
+  std::size_t m = 0;
+
+  static std::size_t offset(std::size_t d) { return (d - 1) * d / 2; }
+
+  bool is_zero(std::size_t d) const;
+
+ public:
+  explicit PeriodicityDetector(std::size_t max_length);
+
+  void push(int x);
+  void clear();
+
+  std::size_t length() const { return m; }
+
+  // How many of the lower half bins (k < M / 2) of the current prefix are 0
+  std::size_t zero_bins() const;
+};
+
+// Whether the DFT of some prefix of `diffs`, from `min_length` characters on,
+// has at least a quarter of its lower half bins at zero: the diffs of the
+// right plaintext repeat with the key once the random characters are removed
+bool has_periodic_prefix(const Encoded &diffs, std::size_t min_length);
+
+#endif  // PERIODICITY_H__
@@ -0,0 +1,41 @@
+#ifndef PROTOCOL_H__
+#define PROTOCOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Framing of the requests and responses of main serve.
+///
+/// Every message is a frame: a 4-byte big-endian payload length, then the
+/// payload. A request payload is one test 1 ciphertext. Its response payload
+/// is "<answer> <latency_us>": the 1-based candidate, or '-' if the
+/// ciphertext has no answer or cannot be analyzed, and the microseconds from
+/// the arrival of the request to its answer. Responses on a connection come
+/// in the order of its requests, so a client may pipeline any number of
+/// requests.
+
+static constexpr std::size_t kFrameHeaderSize = 4;
+
+/// @brief Longest payload accepted; longer frames close the connection
+static constexpr std::uint32_t kMaxFramePayload = 1 << 20;
+
+// Append a frame holding `payload` to `out`
+void append_frame(std::string &out, std::string_view payload);
+
+// Take the first complete frame off the front of `buffer`: `payload` views
+// its payload and `buffer` moves past it. Returns false if `buffer` does not
+// hold a complete frame yet. Sets `malformed` if the frame announces a
+// payload longer than kMaxFramePayload.
+bool take_frame(std::string_view &buffer, std::string_view &payload,
+                bool &malformed);
+
+// Blocking frame I/O on a file descriptor, retrying interrupted and short
+// reads and writes. read_frame returns std::nullopt at the end of the input,
+// on an error, or on a malformed frame.
+bool write_frame(int fd, std::string_view payload);
+std::optional<std::string> read_frame(int fd);
+
+#endif  // PROTOCOL_H__
@@ -0,0 +1,81 @@
+#ifndef RECOVERY_H__
+#define RECOVERY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/// @brief Key and random characters of a ciphertext, recovered against the
+/// plaintext it was encrypted from
+struct KeyRecovery {
+  /// @brief Key shifts; the j-th plaintext character is shifted by
+  /// key[(j + 1) % key.size()], as in enc.py
+  std::vector<int> key;
+
+  /// @brief Positions of the random characters in the ciphertext
+  std::vector<std::size_t> random_indices;
+
+  /// @brief Plaintext characters the alignment could not explain with the
+  /// key; 0 unless the plaintext or the key length is wrong
+  std::size_t mismatches = 0;
+};
+
+/// @brief Recovers the key and the random insertions once the plaintext is
+/// known, e.g. after EntropyAnalysis::run picked it.
+///
+/// The ciphertext is the plaintext with D = N - L random characters inserted,
+/// so plaintext character j sits at cipher position j + d_j, where the
+/// offset d_j never decreases and stays within the band [0, D]. For a key
+/// length t and a key, a Viterbi pass over j finds the offsets with the
+/// fewest characters c[j + d_j] - p[j] != key[(j + 1) % t]. The best offset
+/// up to d is a running minimum, so each plaintext character costs
+/// O(band), and a single bit per band cell is enough to trace the path back:
+/// one 64-bit word per plaintext character.
+///
+/// The key is first voted from the cells near the diagonal d = j * D / L,
+/// then re-voted along the aligned path until it is stable. Every key length
+/// up to kMaxKeyLength is tried, and the fewest mismatches win.
+class RecoveryAnalysis {
+ private:
+  Encoded cipher;
+  Encoded plain;
+
+  /// @brief Number of random characters, D
+  std::size_t n_randoms = 0;
+
+  /// @brief Bit d of from_below[j]: whether the best alignment of
+  /// plain[0..j] with offset at most d has an offset below d
+  std::vector<std::uint64_t> from_below;
+
+  /// @brief Cipher position of every plaintext character on the last path
+  std::vector<std::size_t> positions;
+
+  std::size_t align(const std::vector<int> &key);
+  std::vector<int> initial_key(std::size_t key_length) const;
+  std::vector<int> path_key(std::size_t key_length) const;
+  KeyRecovery recover_with(std::size_t key_length);
+
+ public:
+  static constexpr std::size_t kMaxKeyLength = 24;
+
+  /// @brief Widest band the path bits hold
+  static constexpr std::size_t kMaxBand = 64;
+
+  /// @brief Offsets on either side of the diagonal voting the initial key
+  static constexpr std::size_t kInitialBand = 6;
+
+  /// @brief Re-votes of the key along the path at most
+  static constexpr std::size_t kMaxRounds = 8;
+
+  RecoveryAnalysis(const std::string &ciphertext, const std::string &plaintext);
+
+  // The key and random characters, or std::nullopt if the ciphertext is
+  // shorter than the plaintext or needs more than kMaxBand - 1 insertions
+  std::optional<KeyRecovery> run();
+};
+
+#endif  // RECOVERY_H__
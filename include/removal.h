@@ -0,0 +1,126 @@
+#ifndef REMOVAL_H__
+#define REMOVAL_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "common.h"
+#include "entropy_counter.h"
+#include "packed.h"
+
+/// @brief Diffs between a ciphertext and a plaintext, with the ciphertext
+/// shifted left by 0..max_shift characters:
+///   at(s, j) = diff(cipher[j + s], plain[j])   for j < length
+/// Removing characters from the ciphertext only shifts what follows them, so
+/// the diff stream of any removal set is a patchwork of these streams.
+class ShiftedDiffs {
+ private:
+  std::size_t length;
+  std::size_t max_shift;
+  std::vector<std::uint8_t> diffs;
+
+ public:
+  // `plain` holds at least `length` symbols, e.g. a row of CandidateStreams
+  ShiftedDiffs(const Encoded &cipher, const std::uint8_t *plain,
+               std::size_t length, std::size_t max_shift);
+
+  std::size_t size() const { return length; }
+  std::size_t shifts() const { return max_shift + 1; }
+
+  int at(std::size_t shift, std::size_t j) const {
+    return diffs[shift * length + j];
+  }
+};
+
+/// @brief Diff stream of the ciphertext with some characters removed, read
+/// through a ShiftedDiffs cache instead of rebuilding the ciphertext.
+///
+/// Positions are those of the current (already shortened) ciphertext, as with
+/// removing characters from a string one after another.
+class RemovalView {
+ private:
+  const ShiftedDiffs &cache;
+
+  /// @brief shift[j]: number of characters removed up to the character now
+  /// at position j. One extra entry for the candidate past the last position.
+  std::vector<std::size_t> shift;
+
+  /// @brief Removed positions, in ciphertext coordinates, sorted
+  std::vector<std::size_t> removed_indices;
+
+  std::size_t shift_after(std::size_t j) const {
+    return shift[std::min(j + 1, shift.size() - 1)];
+  }
+
+ public:
+  explicit RemovalView(const ShiftedDiffs &cache);
+
+  // Diff at position j of the current stream
+  int at(std::size_t j) const { return cache.at(shift[j], j); }
+
+  // Diff at position j once one more character at or before j is removed
+  int at_removed(std::size_t j) const {
+    return cache.at(1 + shift_after(j), j);
+  }
+
+  // Histogram of positions [0, end) if the character at `i` were removed
+  EntropyCounter counter_without(std::size_t i, std::size_t end) const;
+
+  // Move a counter from counter_without(i, end) to counter_without(i + 1, end)
+  // in O(1), for i < end
+  void advance(EntropyCounter &counter, std::size_t i) const {
+    counter.remove(at_removed(i));
+    counter.add(at(i));
+  }
+
+  // Remove the character now at position i; no-op past the cached window
+  void remove(std::size_t i);
+
+  std::size_t n_removed() const { return removed_indices.size(); }
+  const std::vector<std::size_t> &removed() const { return removed_indices; }
+
+  // The ciphertext without the removed characters
+  Encoded apply(const Encoded &cipher) const;
+};
+
+/// @brief Greedy removal of the characters that lower the entropy of the
+/// diffs against one plaintext, one character per step.
+///
+/// Each step scans the positions after the previous removal, and removes the
+/// one before the entropy first rises again. Round n of the optimization
+/// extends the removals of round n - 1, so the optimizer keeps its state
+/// between steps instead of redoing the first n - 1 removals.
+class GreedyRemoval {
+ private:
+  const ShiftedDiffs diffs;
+  RemovalView view;
+  const std::size_t search_space;
+
+  std::size_t cursor = 0;
+  std::size_t min_ci = 0;
+  float prev_ent = 1000.0f;
+
+ public:
+  // Up to max_removals steps over the first search_space diffs; `plain`
+  // holds at least search_space symbols
+  GreedyRemoval(const Encoded &cipher, const std::uint8_t *plain,
+                std::size_t search_space, std::size_t max_removals);
+
+  GreedyRemoval(const GreedyRemoval &) = delete;
+  GreedyRemoval &operator=(const GreedyRemoval &) = delete;
+
+  // Remove one more character. Returns false, leaving the optimizer unusable,
+  // if `cancelled` turns true before the step finishes.
+  bool step(const std::function<bool()> &cancelled = {});
+
+  // Removed positions, in ciphertext coordinates, sorted
+  const std::vector<std::size_t> &removed() const { return view.removed(); }
+
+  // The ciphertext without the removed characters
+  Encoded apply(const Encoded &cipher) const { return view.apply(cipher); }
+};
+
+#endif  // REMOVAL_H__
@@ -0,0 +1,72 @@
+#ifndef REMOVAL_SEARCH_H__
+#define REMOVAL_SEARCH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+#include "entropy_counter.h"
+#include "removal.h"
+#include "thread_pool.h"
+
+/// @brief Positions removed from the ciphertext, sorted
+typedef std::vector<std::size_t> RemovalSet;
+
+/// @brief Search over every set of `n_remove` positions removed from the
+/// first `diffs.size()` characters of the ciphertext, scoring each set by the
+/// entropy of the resulting diffs (remove_many_chars_with_fft_test in
+/// decryption.py).
+///
+/// Sets are enumerated depth first in lexicographic order, keeping the
+/// histogram up to date in O(1) per step. A subtree is skipped when even the
+/// best completion of its fixed prefix cannot reach the threshold: entropy is
+/// concave, so over all ways to fill the remaining positions it is lowest
+/// when they all take the same value, which bounds the whole subtree.
+class RemovalSetSearch {
+ private:
+  const ShiftedDiffs &diffs;
+  const std::size_t n_remove;
+
+  /// @brief reachable[s * (length + 1) + j]: bitmask of the values of the
+  /// diffs at shift s from position j on
+  std::vector<uint32_t> reachable;
+
+  uint32_t reachable_from(std::size_t shift_lo, std::size_t j) const;
+
+  float lower_bound(const EntropyCounter &prefix, std::size_t shift_lo,
+                    std::size_t j) const;
+
+  void search_from(std::size_t level, std::size_t lo, EntropyCounter full,
+                   EntropyCounter prefix, RemovalSet &removed, float threshold,
+                   std::vector<RemovalSet> &found) const;
+
+  void search_prefix(const RemovalSet &prefix, float threshold,
+                     std::vector<RemovalSet> &found) const;
+
+  // search_prefix on the K-prefixes of ranks [first, end), into found[rank]
+  template <std::size_t K>
+  void search_prefixes(std::uint64_t first, std::uint64_t end,
+                       float threshold,
+                       std::vector<std::vector<RemovalSet>> &found) const;
+
+ public:
+  // `diffs` must cover shifts 0..n_remove
+  RemovalSetSearch(const ShiftedDiffs &diffs, std::size_t n_remove);
+
+  // Diff stream with the characters at `removed` taken out
+  Encoded diffs_without(const RemovalSet &removed) const;
+
+  float entropy_without(const RemovalSet &removed) const;
+
+  // Average and standard deviation of the entropy over all removal sets,
+  // estimated from `n_samples` sets drawn with a fixed seed (exact when the
+  // space is that small)
+  std::pair<float, float> entropy_stats(std::size_t n_samples) const;
+
+  // Every removal set whose entropy is below `threshold`, in lexicographic
+  // order. The space is split by its first removals across `pool`, if any.
+  std::vector<RemovalSet> below(float threshold, ThreadPool *pool) const;
+};
+
+#endif  // REMOVAL_SEARCH_H__
@@ -0,0 +1,40 @@
+#ifndef REPEATS_H__
+#define REPEATS_H__
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+/// @brief Index of the repeated substrings of a text, built once from its
+/// suffix array and LCP array.
+///
+/// All occurrences of a substring of length t are adjacent in the suffix
+/// array, in a run where consecutive suffixes share at least t characters, so
+/// every repeat of every length is found by scanning the LCP array.
+class RepeatIndex {
+ private:
+  const std::string text;
+
+  /// @brief Starting positions of the suffixes, in lexicographic order
+  std::vector<std::size_t> suffix_array;
+
+  /// @brief lcp[i]: length of the common prefix of suffixes i - 1 and i of the
+  /// suffix array (lcp[0] = 0)
+  std::vector<std::size_t> lcp;
+
+  void build_suffix_array();
+  void build_lcp();
+
+ public:
+  explicit RepeatIndex(std::string text);
+
+  // Distances between consecutive occurrences of every substring of length
+  // min_length..max_length that occurs at least twice without overlapping.
+  // Occurrences are taken left to right, skipping those that overlap the
+  // previous one, as std::string::find would.
+  std::set<std::size_t> spacings(std::size_t min_length,
+                                 std::size_t max_length) const;
+};
+
+#endif  // REPEATS_H__
@@ -0,0 +1,159 @@
+#ifndef SERVER_H__
+#define SERVER_H__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+#include "thread_pool.h"
+
+/// @brief Test 1 as a long-running service, for main serve.
+///
+/// The candidates are loaded and encoded once, when the server starts, and
+/// every request shares them, so a request costs its analysis alone: no
+/// process start, no corpus parsing, no candidate encoding. Clients connect
+/// to a Unix domain socket, or a single client talks on stdin and stdout, and
+/// exchange the frames of protocol.h.
+///
+/// One thread multiplexes the connections with poll(). The requests that
+/// arrive together, up to batch_window after the oldest one waiting and up
+/// to kMaxBatch, are dispatched as one batch: identical ciphertexts in a
+/// batch are analyzed once, and every distinct ciphertext runs the
+/// multi-candidate kernels as one task of the pool. Connections are not read
+/// while kMaxOutstanding requests per worker are in the server, so a client
+/// flooding it waits in its socket buffer.
+class AnalysisServer {
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Connection {
+    int in_fd;
+    int out_fd;
+    bool owns_fds;
+
+    /// @brief Bytes read but not framed yet, and frames not written yet
+    std::string input;
+    std::string output;
+
+    /// @brief Responses in request order, from sequence number first_seq;
+    /// empty until answered
+    std::deque<std::string> responses;
+    std::uint64_t first_seq = 0;
+    std::uint64_t next_seq = 0;
+
+    bool input_closed = false;
+  };
+
+  /// @brief Where the answer of a request goes
+  struct Target {
+    std::uint64_t connection;
+    std::uint64_t seq;
+    Clock::time_point arrived;
+  };
+
+  struct Request {
+    Target target;
+    std::string ciphertext;
+  };
+
+  struct Completion {
+    Target target;
+    std::string response;
+  };
+
+  const std::shared_ptr<const CandidateStreams> candidates;
+  const std::size_t search_space;
+
+  // Shortest ciphertext the analysis can handle
+  std::size_t min_length;
+
+  std::chrono::microseconds batch_window{0};
+
+  int listen_fd = -1;
+  std::string socket_path;
+
+  std::map<std::uint64_t, Connection> connections;
+  std::uint64_t next_connection = 0;
+
+  /// @brief Requests received but not dispatched yet, oldest first
+  std::vector<Request> waiting;
+
+  /// @brief Requests dispatched but not answered yet
+  std::size_t n_outstanding = 0;
+
+  std::size_t n_answered = 0;
+
+  /// @brief Answers of the pool tasks, handed over to the poll thread,
+  /// which a byte on the wake pipe tells about them
+  std::mutex completed_mutex;
+  std::vector<Completion> completed;
+
+  int wake_fds[2] = {-1, -1};
+
+  /// @brief Where metrics dumps requested with request_metrics_dump() go
+  std::ostream *metrics_out;
+
+  /// @brief Last member, so that its workers are gone before the rest
+  ThreadPool pool;
+
+  void add_connection(int in_fd, int out_fd, bool owns_fds);
+  void close_connection(std::uint64_t id);
+
+  void accept_connections();
+  bool read_requests(std::uint64_t id, Connection &connection);
+  bool write_responses(Connection &connection);
+
+  bool analyzable(const std::string &ciphertext) const;
+  void dispatch();
+  void analyze(std::string ciphertext, std::vector<Target> targets);
+  void collect_completed();
+
+  std::size_t max_outstanding() const { return pool.size() * kMaxOutstanding; }
+
+ public:
+  static constexpr std::size_t kMaxBatch = 64;
+  static constexpr std::size_t kMaxOutstanding = 16;
+
+  AnalysisServer(std::shared_ptr<const CandidateStreams> candidates,
+                 std::size_t search_space, std::size_t n_workers);
+  ~AnalysisServer();
+
+  AnalysisServer(const AnalysisServer &) = delete;
+  AnalysisServer &operator=(const AnalysisServer &) = delete;
+
+  // Wait up to `window` after a request for more to batch with it; 0, the
+  // default, dispatches whatever one poll() round brought in
+  void set_batch_window(std::chrono::microseconds window) {
+    batch_window = window;
+  }
+
+  void dump_metrics_to(std::ostream *out) { metrics_out = out; }
+
+  // Listen on a Unix domain socket at `path`, replacing a stale socket file.
+  // Returns false, with a message on stderr, if it cannot.
+  bool listen_on(const std::string &path);
+
+  // Serve a single client on stdin and stdout instead
+  void serve_stdio();
+
+  // Serve until request_stop(), or until the stdio client hangs up and has
+  // every answer. Returns the number of requests answered.
+  std::size_t run();
+
+  // Async-signal-safe: make run() return once the requests in the server
+  // are answered
+  static void request_stop();
+
+  // Async-signal-safe: make run() look at the stop and metrics dump requests
+  static void interrupt();
+};
+
+#endif  // SERVER_H__
@@ -0,0 +1,113 @@
+#ifndef THREAD_POOL_H__
+#define THREAD_POOL_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// @brief Fixed-size work-stealing pool.
+///
+/// Every worker owns a deque: tasks submitted from a worker go to the back of
+/// its own deque and are popped LIFO, idle workers steal from the front of
+/// the others' deques. Tasks submitted from outside the pool go to a shared
+/// FIFO injection queue, so they start in submission order. A thread waiting
+/// on a task of the pool should use `wait`, which runs queued tasks in the
+/// meantime, so tasks may submit and wait on further tasks without
+/// deadlocking the pool.
+class ThreadPool {
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  WorkQueue injected;
+  std::vector<std::thread> workers;
+
+  std::mutex sleep_mutex;
+  std::condition_variable cv;
+  std::atomic<std::size_t> n_queued{0};
+  bool stopping = false;
+
+  void push(std::function<void()> task);
+  bool pop(std::size_t home, std::function<void()> &task);
+  void work(std::size_t index);
+
+ public:
+  // `n_threads` == 0 uses one thread per hardware core
+  explicit ThreadPool(std::size_t n_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  std::size_t size() const { return workers.size(); }
+
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F &&f) {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+    push([task]() { (*task)(); });
+    return result;
+  }
+
+  // Run one queued task on the calling thread, if there is any
+  bool run_pending_task();
+
+  // Block until `future` is ready, running queued tasks while waiting
+  template <typename T>
+  T wait(std::future<T> &future) {
+    while (future.wait_for(std::chrono::seconds(0)) !=
+           std::future_status::ready) {
+      if (!run_pending_task()) {
+        future.wait_for(std::chrono::microseconds(50));
+      }
+    }
+    return future.get();
+  }
+};
+
+/// @brief Cooperative cancellation for a group of tasks ordered by index,
+/// where the lowest-indexed task that succeeds wins: once task `i` succeeds,
+/// every task after `i` may stop, but the tasks before it must still finish.
+class OrderedCancellation {
+ private:
+  std::atomic<std::size_t> winner_index{
+      std::numeric_limits<std::size_t>::max()};
+
+ public:
+  bool cancelled(std::size_t task) const {
+    return winner_index.load(std::memory_order_relaxed) < task;
+  }
+
+  void succeed(std::size_t task) {
+    std::size_t current = winner_index.load(std::memory_order_relaxed);
+    while (task < current &&
+           !winner_index.compare_exchange_weak(current, task,
+                                               std::memory_order_relaxed)) {
+    }
+  }
+
+  std::optional<std::size_t> winner() const {
+    std::size_t w = winner_index.load(std::memory_order_acquire);
+    if (w == std::numeric_limits<std::size_t>::max()) {
+      return std::nullopt;
+    }
+    return w;
+  }
+};
+
+#endif  // THREAD_POOL_H__
@@ -0,0 +1,200 @@
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+/// Analysis diagnostics as binary trace events.
+///
+/// A site records an event id and up to kTraceMaxArgs numbers into a ring
+/// buffer owned by the recording thread, with no lock and no formatting.
+/// trace_flush() drains the rings of every thread off the hot path, orders
+/// the events by time and decodes them into text with the formats below.
+///
+/// Sites go through TRACE_INFO, TRACE_DEBUG and TRACE_VERBOSE. Levels above
+/// TRACE_LEVEL never evaluate their arguments nor generate any code, so a
+/// build with -DTRACE_LEVEL=0 has no tracing at all. Enabled levels can still
+/// be switched off at run time with set_tracing(false), e.g. in batch mode.
+///
+/// Formats take {i} (signed), {u} (unsigned), {u2} (unsigned, two digits
+/// zero-padded) and {f} (floating point) placeholders, checked against the
+/// arguments of every site at compile time.
+
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_INFO 1
+#define TRACE_LEVEL_DEBUG 2
+#define TRACE_LEVEL_VERBOSE 3
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_VERBOSE
+#endif
+
+#define TRACE_EVENTS(X)                                                      \
+  X(kEndLine, "\n")                                                          \
+  X(kItem, " {u}")                                                           \
+  X(kSignedItem, " {i}")                                                     \
+  X(kSymbol, "{u2} ")                                                        \
+  X(kKasiskiStart, "Kasiski Analysis\n")                                     \
+  X(kKasiskiFactor, "[DEBUG] {u}:{f}\n")                                     \
+  X(kKasiskiFactors, "[DEBUG] Factors collected...")                         \
+  X(kKasiskiFactorItem, "{u} ")                                              \
+  X(kCoincidenceRates, "[DEBUG] Coincidence rates...")                       \
+  X(kCoincidenceRate, "{u}:{f} ")                                            \
+  X(kEntropyStart, "Entropy Analysis\n")                                     \
+  X(kTrendStats, "[TRND] Trend Difference: avg={f} std_dev={f}\n")           \
+  X(kAnomalyLowStdDev, "[ANOM] Anomaly detection failed: std_dev is too "    \
+                       "small\n")                                            \
+  X(kAnomalyPair, "[ANOM] Anomaly detected: {u} {u} {f}\n")                  \
+  X(kAnomalyNotUnique, "[ANOM] Most frequent index is not unique\n")         \
+  X(kAnomalyNoMedian, "[ANOM] No unique trend far below the median\n")       \
+  X(kAnomalyMedian, "[ANOM] Anomaly detected: {u} {f}\n")                    \
+  X(kOptimizeStart, "[OPT] Optimizing a ciphertext with entropy {f}\n")      \
+  X(kOptimizeStep, "[OPT] {u} {f}\n")                                        \
+  X(kOptimizeRemoval, "[OPT] min_ent={f} min_ci={u}\n")                      \
+  X(kRemovalSets, "[RMV] plaintext {u}: {u} sets of {u} removals below "     \
+                  "{f}\n")                                                   \
+  X(kRemovalPeriodic, "[RMV] Periodic diffs after removing")                 \
+  X(kEntropyTarget, "[ENT] Optimization target= {u}-th plaintext, expected " \
+                    "number of random characters: {u}\n")                    \
+  X(kEntropyResolution, "[ENT] First pass at search space {u}\n")            \
+  X(kEntropyCached, "[ENT] Same {u} removals as an analyzed ciphertext\n")   \
+  X(kOnlineDecision, "[ONL] Plaintext {u} with confidence {f} after {u} "    \
+                     "symbols\n")                                            \
+  X(kColumnScore, "[COL] Plaintext {u}: {f} of the column pairs agree at "  \
+                  "key length {u}\n")                                        \
+  X(kEntropyMaxStdDev, "[ENT] Answering with the ciphertext with the "       \
+                       "largest std dev ({f})\n")                            \
+  X(kWordStart, "Word Analysis\n")                                           \
+  X(kWordAttempt, "[WORD] key length {u}, {u} randoms per {u}: {u} "         \
+                  "expansions\n")                                            \
+  X(kWordDecrypted, "[WORD] key length {u}, {u} randoms per {u}: {u} "       \
+                    "expansions, decrypted\n")                               \
+  X(kWordKey, "[WORD] Key:")                                                 \
+  X(kRecoveryStart, "Recovery Analysis\n")                                   \
+  X(kRecoveryBand, "[REC] {u} cipher characters cannot encrypt {u} "         \
+                   "plaintext characters within the band\n")                 \
+  X(kRecoveryResult, "[REC] key length {u}, {u} random characters, {u} "     \
+                     "mismatches\n")
+
+enum class TraceEvent : std::uint16_t {
+#define TRACE_EVENT_ID(name, format) name,
+  TRACE_EVENTS(TRACE_EVENT_ID)
+#undef TRACE_EVENT_ID
+};
+
+inline constexpr const char *kTraceFormats[] = {
+#define TRACE_EVENT_FORMAT(name, format) format,
+    TRACE_EVENTS(TRACE_EVENT_FORMAT)
+#undef TRACE_EVENT_FORMAT
+};
+
+static constexpr std::size_t kTraceMaxArgs = 4;
+
+/// @brief Events a thread can hold between two flushes; later ones are
+/// dropped and counted
+static constexpr std::size_t kTraceCapacity = 1 << 16;
+
+union TraceArg {
+  std::int64_t i;
+  double f;
+};
+
+struct TraceRecord {
+  std::uint64_t time_ns;
+  TraceEvent event;
+  TraceArg args[kTraceMaxArgs];
+};
+
+// Type of the k-th placeholder of `format`, 'i', 'u' or 'f', or 0 past the
+// last one
+constexpr char trace_placeholder(const char *format, std::size_t k) {
+  for (; *format != '\0'; format++) {
+    if (*format == '{') {
+      if (k == 0) {
+        return format[1];
+      }
+      k--;
+    }
+  }
+  return 0;
+}
+
+constexpr std::size_t trace_arity(TraceEvent event) {
+  std::size_t n = 0;
+  while (trace_placeholder(kTraceFormats[(std::size_t)event], n) != 0) {
+    n++;
+  }
+  return n;
+}
+
+template <TraceEvent E, typename... Args, std::size_t... I>
+constexpr bool trace_args_match(std::index_sequence<I...>) {
+  return ((std::is_floating_point_v<Args> ==
+           (trace_placeholder(kTraceFormats[(std::size_t)E], I) == 'f')) &&
+          ...);
+}
+
+bool tracing();
+void set_tracing(bool enabled);
+
+// Append `record` to the ring of the calling thread
+void trace_push(const TraceRecord &record);
+
+// Decode the events of every thread recorded since the last flush, oldest
+// first, into `out`
+void trace_flush(std::ostream &out);
+void trace_flush();
+
+template <TraceEvent E, typename... Args>
+inline void trace_event(Args... args) {
+  static_assert(sizeof...(Args) <= kTraceMaxArgs, "Too many trace arguments");
+  static_assert(trace_arity(E) == sizeof...(Args),
+                "Trace arguments do not match the format");
+  static_assert(
+      trace_args_match<E, Args...>(std::index_sequence_for<Args...>{}),
+      "Trace argument types do not match the format");
+  if (!tracing()) {
+    return;
+  }
+  TraceRecord record;
+  record.event = E;
+  std::size_t k = 0;
+  auto put = [&record, &k](auto arg) {
+    if constexpr (std::is_floating_point_v<decltype(arg)>) {
+      record.args[k++].f = arg;
+    } else {
+      record.args[k++].i = (std::int64_t)arg;
+    }
+  };
+  (put(args), ...);
+  (void)put;
+  trace_push(record);
+}
+
+// A disabled site only appears in an unevaluated operand: it generates no
+// code, but its arguments are still checked and count as used
+#define TRACE_DISABLED(event, ...) \
+  ((void)sizeof((trace_event<TraceEvent::event>(__VA_ARGS__), 0)))
+
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(event, ...) trace_event<TraceEvent::event>(__VA_ARGS__)
+#else
+#define TRACE_INFO(event, ...) TRACE_DISABLED(event, __VA_ARGS__)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(event, ...) trace_event<TraceEvent::event>(__VA_ARGS__)
+#else
+#define TRACE_DEBUG(event, ...) TRACE_DISABLED(event, __VA_ARGS__)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_VERBOSE
+#define TRACE_VERBOSE(event, ...) trace_event<TraceEvent::event>(__VA_ARGS__)
+#else
+#define TRACE_VERBOSE(event, ...) TRACE_DISABLED(event, __VA_ARGS__)
+#endif
+
+#endif  // TRACE_H__
@@ -0,0 +1,132 @@
+#ifndef WORDS_H__
+#define WORDS_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+/// @brief Trie over the dictionary words, where a space after a complete word
+/// leads back to the root: every path from the root spells a prefix of a
+/// sequence of dictionary words separated by single spaces.
+class WordTrie {
+ public:
+  static constexpr std::int32_t kNone = -1;
+  static constexpr std::int32_t kRoot = 0;
+
+  explicit WordTrie(const std::vector<std::string> &words);
+
+  // Node reached from `node` by the encoded symbol, or kNone
+  std::int32_t next(std::int32_t node, int symbol) const {
+    return nodes[node].next[symbol];
+  }
+
+  // Bitmask of the symbols leaving `node`
+  std::uint32_t symbols(std::int32_t node) const {
+    return nodes[node].symbols;
+  }
+
+  std::size_t size() const { return nodes.size(); }
+
+  // Whether the `length` symbols of base-27 `code`, the first one most
+  // significant, occur in some sequence of words; 0 < length <= kFactorLength
+  bool is_factor(std::size_t code, std::size_t length) const {
+    return (factors[length][code >> 6] >> (code & 63)) & 1u;
+  }
+
+  static constexpr std::size_t kFactorLength = 5;
+
+ private:
+  struct Node {
+    std::array<std::int32_t, kAlphabetSize> next;
+    std::uint32_t symbols = 0;
+  };
+  std::vector<Node> nodes;
+
+  /// @brief Bit `code` of factors[m]: whether the m symbols of base-27
+  /// `code` occur in some sequence of words
+  std::vector<std::vector<std::uint64_t>> factors;
+
+  std::int32_t add_node();
+  void add_factors(std::int32_t node, std::size_t depth, std::size_t code);
+};
+
+/// @brief A ciphertext decrypted into dictionary words
+struct WordDecryption {
+  std::string plaintext;
+
+  /// @brief Key shifts; the j-th plaintext character is shifted by
+  /// key[(j + 1) % key.size()], as in enc.py
+  std::vector<int> key;
+
+  /// @brief Positions of the random characters in the ciphertext
+  std::vector<std::size_t> random_indices;
+};
+
+/// @brief Test 2: decrypts a ciphertext whose plaintext is a sequence of
+/// dictionary words, by searching word sequences and key shifts together.
+///
+/// For a key length t, the hypotheses walk the ciphertext, each character
+/// either random or the encryption of the next plaintext character. The
+/// plaintext must follow the trie. A key shift is free the first time its
+/// key position is used, and from then on it fixes the plaintext character,
+/// which must continue the trie. Until every shift is fixed, all hypotheses
+/// are equally likely, so they cannot be ranked and a breadth-first beam
+/// would drop the right one at random. Instead the search is depth first,
+/// with memory bounded by the length of the ciphertext. Once the shifts are
+/// fixed, nearly every wrong hypothesis dies within a few characters.
+///
+/// Most of the pruning comes from looking ahead. Fixing the shift of
+/// plaintext position j also decrypts position j + t, about t characters
+/// later in the ciphertext. The last kFactorLength decrypted characters there
+/// must occur somewhere in a sequence of words. Every alignment those
+/// characters may have is tried, given the random characters that may come
+/// in between. This prunes the wrong hypotheses while they are being
+/// generated, not t characters later.
+///
+/// Random characters are limited to kMaxRandomsPerWindow in any
+/// kRandomWindow consecutive characters, starting from the tightest limit,
+/// and every attempt is capped at kMaxExpansions steps. Key lengths are
+/// tried in the order of the coincidence analysis.
+class WordAnalysis {
+ private:
+  const std::string ciphertext;
+  Encoded cipher;
+  const WordTrie trie;
+
+  std::size_t key_length = 0;
+  std::size_t max_randoms = 0;
+
+  std::vector<int> key;
+  std::vector<std::size_t> key_uses;
+  Encoded plain;
+  std::vector<std::size_t> randoms;
+  std::size_t expansions = 0;
+
+  bool search(std::size_t i, std::int32_t node);
+  bool emit(std::size_t i, std::int32_t node, int symbol);
+  bool random_allowed(std::size_t i) const;
+  bool lookahead(std::size_t i) const;
+  bool lookahead_from(std::size_t pos, std::size_t k, std::size_t skips,
+                      std::size_t code, std::size_t scale,
+                      const int *shifts) const;
+
+  std::optional<WordDecryption> decrypt_with(std::size_t key_length,
+                                             std::size_t max_randoms);
+
+ public:
+  static constexpr std::size_t kMaxKeyLength = 24;
+  static constexpr std::size_t kRandomWindow = 20;
+  static constexpr std::size_t kMaxRandomsPerWindow = 8;
+  static constexpr std::size_t kMaxExpansions = 1 << 15;
+
+  WordAnalysis(std::string ciphertext, const std::vector<std::string> &words);
+
+  std::optional<WordDecryption> run();
+};
+
+#endif  // WORDS_H__
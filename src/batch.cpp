@@ -0,0 +1,121 @@
+#include "batch.h"
+
+#include <glob.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "entropy.h"
+#include "metrics.h"
+
+BatchAnalysis::BatchAnalysis(std::shared_ptr<const CandidateStreams> candidates,
+                             std::size_t search_space, std::size_t n_workers)
+    : candidates(std::move(candidates)),
+      search_space(search_space),
+      pool(n_workers),
+      metrics_out(&std::cerr) {
+  max_pending = pool.size() * 4;
+  min_length = EntropyAnalysis::min_length(*this->candidates, search_space);
+}
+
+static std::vector<std::string> expand_source(const std::string &source) {
+  std::vector<std::string> paths;
+  if (std::filesystem::is_directory(source)) {
+    for (const auto &entry : std::filesystem::directory_iterator(source)) {
+      if (entry.is_regular_file()) {
+        paths.push_back(entry.path().string());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+
+  if (source.find_first_of("*?[") != std::string::npos) {
+    glob_t matches;
+    if (glob(source.c_str(), 0, nullptr, &matches) == 0) {
+      for (std::size_t i = 0; i < matches.gl_pathc; i++) {
+        paths.push_back(matches.gl_pathv[i]);
+      }
+    }
+    globfree(&matches);
+    return paths;
+  }
+
+  paths.push_back(source);
+  return paths;
+}
+
+void BatchAnalysis::write_front(std::ostream &out) {
+  auto &front = pending.front();
+  auto answer = front.second.get();
+  out << front.first << ' ';
+  if (answer.has_value()) {
+    out << (answer.value() + 1);
+  } else {
+    out << '-';
+  }
+  out << '\n';
+  pending.pop_front();
+  n_done++;
+
+  if (take_metrics_dump_request()) {
+    metrics().write_json(*metrics_out);
+  }
+}
+
+void BatchAnalysis::submit(std::string name, std::string ciphertext,
+                           std::ostream &out) {
+  if (pending.size() >= max_pending) {
+    write_front(out);
+  }
+
+  if (!EntropyAnalysis::analyzable(ciphertext, min_length)) {
+    std::cerr << "[BATCH] Skipping " << name
+              << ": ciphertext is too short or has characters other than "
+                 "spaces and lowercase letters\n";
+    std::promise<std::optional<std::size_t>> skipped;
+    skipped.set_value(std::nullopt);
+    pending.emplace_back(std::move(name), skipped.get_future());
+    return;
+  }
+
+  auto answer = pool.submit([this, ciphertext = std::move(ciphertext)]() {
+    EntropyAnalysis analysis(ciphertext, candidates, search_space);
+    return analysis.run();
+  });
+  pending.emplace_back(std::move(name), std::move(answer));
+}
+
+std::size_t BatchAnalysis::run(const std::string &source, std::ostream &out) {
+  n_done = 0;
+  if (source == "-") {
+    std::string line;
+    std::size_t line_no = 0;
+    while (std::getline(std::cin, line)) {
+      line_no++;
+      if (line.empty()) {
+        continue;
+      }
+      submit(std::to_string(line_no), strip_line_end(std::move(line)), out);
+    }
+  } else {
+    for (const auto &path : expand_source(source)) {
+      std::ifstream file(path);
+      std::string ciphertext;
+      if (!file || !std::getline(file, ciphertext)) {
+        std::cerr << "[BATCH] Cannot read a ciphertext from " << path << "\n";
+        continue;
+      }
+      submit(path, strip_line_end(std::move(ciphertext)), out);
+    }
+  }
+
+  while (!pending.empty()) {
+    write_front(out);
+  }
+  out.flush();
+
+  return n_done;
+}
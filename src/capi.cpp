@@ -0,0 +1,198 @@
+#include "capi.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "dictionary.h"
+#include "entropy.h"
+#include "entropy_counter.h"
+#include "packed.h"
+#include "removal.h"
+
+struct analysis_candidates {
+  std::shared_ptr<const CandidateStreams> streams;
+};
+
+namespace {
+
+bool valid_symbols(const std::uint8_t *symbols, std::size_t n) {
+  return std::all_of(symbols, symbols + n,
+                     [](std::uint8_t s) { return s < kAlphabetSize; });
+}
+
+// Run `body` without letting an exception, such as std::bad_alloc, cross the
+// C ABI
+template <typename F>
+int guarded(F body) {
+  try {
+    return body();
+  } catch (const std::exception &) {
+    return ANALYSIS_FAILURE;
+  }
+}
+
+}  // namespace
+
+int analysis_abi_version(void) { return ANALYSIS_ABI_VERSION; }
+
+int analysis_encode(const char *text, std::size_t length, std::uint8_t *out) {
+  for (std::size_t i = 0; i < length; i++) {
+    int symbol = DefaultAlphabet::symbol(text[i]);
+    if (symbol < 0) {
+      return ANALYSIS_INVALID_INPUT;
+    }
+    out[i] = symbol;
+  }
+  return ANALYSIS_OK;
+}
+
+int analysis_diff(const std::uint8_t *a, const std::uint8_t *b,
+                  std::size_t length, std::uint8_t *out) {
+  if (!valid_symbols(a, length) || !valid_symbols(b, length)) {
+    return ANALYSIS_INVALID_INPUT;
+  }
+  diff_streams(a, b, out, length);
+  return ANALYSIS_OK;
+}
+
+int analysis_entropy(const std::uint8_t *symbols, std::size_t length,
+                     double *entropy) {
+  if (!valid_symbols(symbols, length)) {
+    return ANALYSIS_INVALID_INPUT;
+  }
+  Histogram histogram{};
+  count_symbols(symbols, length, histogram);
+  EntropyCounter counter;
+  counter.assign(histogram.data());
+  *entropy = counter.entropy();
+  return ANALYSIS_OK;
+}
+
+int analysis_removal_entropies(const std::uint8_t *cipher,
+                               std::size_t cipher_length,
+                               const std::uint8_t *plain, std::size_t length,
+                               const std::int64_t *removal_sets,
+                               std::size_t n_sets, std::size_t n_remove,
+                               double *entropies) {
+  if (cipher_length < length + n_remove ||
+      !valid_symbols(cipher, length + n_remove) ||
+      !valid_symbols(plain, length)) {
+    return ANALYSIS_INVALID_INPUT;
+  }
+  for (std::size_t s = 0; s < n_sets; s++) {
+    const std::int64_t *removed = removal_sets + s * n_remove;
+    for (std::size_t k = 0; k < n_remove; k++) {
+      if (removed[k] < 0 || (k > 0 && removed[k] <= removed[k - 1])) {
+        return ANALYSIS_INVALID_INPUT;
+      }
+    }
+  }
+
+  return guarded([&]() {
+    // One diff stream per shift, and every set a patchwork of them, as in
+    // RemovalSetSearch::diffs_without
+    ShiftedDiffs diffs(Encoded(cipher, cipher + length + n_remove), plain,
+                       length, n_remove);
+    EntropyCounter counter;
+    for (std::size_t s = 0; s < n_sets; s++) {
+      const std::int64_t *removed = removal_sets + s * n_remove;
+      counter.clear();
+      std::size_t shift = 0;
+      for (std::size_t j = 0; j < length; j++) {
+        while (shift < n_remove && (std::size_t)removed[shift] - shift <= j) {
+          shift++;
+        }
+        counter.add(diffs.at(shift, j));
+      }
+      entropies[s] = counter.entropy();
+    }
+    return ANALYSIS_OK;
+  });
+}
+
+analysis_candidates *analysis_candidates_view(const std::uint8_t *rows,
+                                              const std::uint64_t *lengths,
+                                              std::size_t n_candidates,
+                                              std::size_t stride) {
+  if (rows == nullptr || lengths == nullptr || n_candidates == 0) {
+    return nullptr;
+  }
+  std::size_t common_length = stride;
+  for (std::size_t p = 0; p < n_candidates; p++) {
+    if (lengths[p] > stride || !valid_symbols(rows + p * stride, lengths[p])) {
+      return nullptr;
+    }
+    common_length = std::min<std::size_t>(common_length, lengths[p]);
+  }
+  auto *candidates = new (std::nothrow) analysis_candidates;
+  if (candidates == nullptr) {
+    return nullptr;
+  }
+  if (guarded([&]() {
+        candidates->streams = std::make_shared<const CandidateStreams>(
+            rows, lengths, n_candidates, stride, common_length, nullptr);
+        return ANALYSIS_OK;
+      }) != ANALYSIS_OK) {
+    delete candidates;
+    return nullptr;
+  }
+  return candidates;
+}
+
+analysis_candidates *analysis_candidates_open(const char *path) {
+  auto *candidates = new (std::nothrow) analysis_candidates;
+  if (candidates == nullptr) {
+    return nullptr;
+  }
+  guarded([&]() {
+    candidates->streams = load_dictionary(path);
+    return ANALYSIS_OK;
+  });
+  if (candidates->streams == nullptr) {
+    delete candidates;
+    return nullptr;
+  }
+  return candidates;
+}
+
+void analysis_candidates_free(analysis_candidates *candidates) {
+  delete candidates;
+}
+
+std::size_t analysis_candidates_size(const analysis_candidates *candidates) {
+  return candidates->streams->size();
+}
+
+std::size_t analysis_candidates_length(const analysis_candidates *candidates) {
+  return candidates->streams->length();
+}
+
+int analysis_decide(const analysis_candidates *candidates,
+                    const char *ciphertext, std::size_t length,
+                    std::size_t search_space, std::size_t *answer,
+                    std::size_t *decided_search_space) {
+  const CandidateStreams &streams = *candidates->streams;
+  if (search_space > streams.length() ||
+      !EntropyAnalysis::analyzable(
+          std::string_view(ciphertext, length),
+          EntropyAnalysis::min_length(streams, search_space))) {
+    return ANALYSIS_INVALID_INPUT;
+  }
+
+  return guarded([&]() {
+    EntropyAnalysis analysis(std::string(ciphertext, length),
+                             candidates->streams, search_space);
+    auto result = analysis.run();
+    if (decided_search_space != nullptr) {
+      *decided_search_space = analysis.get_search_space();
+    }
+    if (!result.has_value()) {
+      return (int)ANALYSIS_NO_ANSWER;
+    }
+    *answer = result.value();
+    return (int)ANALYSIS_OK;
+  });
+}
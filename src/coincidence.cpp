@@ -0,0 +1,84 @@
+#include "coincidence.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "trace.h"
+
+CoincidenceAnalysis::CoincidenceAnalysis(const std::string &ciphertext) {
+  symbols.reserve(ciphertext.size());
+  for (char c : alphabet_only(ciphertext)) {
+    symbols.push_back(ctoi(c));
+  }
+}
+
+std::size_t CoincidenceAnalysis::count_matches(std::size_t shift) const {
+  if (shift >= symbols.size()) {
+    return 0;
+  }
+  const std::uint8_t *a = symbols.data();
+  const std::uint8_t *b = symbols.data() + shift;
+  const std::size_t n = symbols.size() - shift;
+  std::size_t matches = 0;
+  std::size_t i = 0;
+
+#ifdef __SSE2__
+  // Equal bytes compare to 0xff; subtracting the mask adds one per match to
+  // each byte lane, which is flushed with a sum of absolute differences
+  // before it can wrap after 255 blocks
+  const __m128i zero = _mm_setzero_si128();
+  while (i + 16 <= n) {
+    __m128i lanes = zero;
+    std::size_t blocks = std::min<std::size_t>((n - i) / 16, 255);
+    for (std::size_t k = 0; k < blocks; k++, i += 16) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(x, y));
+    }
+    __m128i sums = _mm_sad_epu8(lanes, zero);
+    matches += _mm_cvtsi128_si32(sums) +
+               _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+  }
+#endif
+
+  for (; i < n; i++) {
+    matches += (a[i] == b[i]);
+  }
+  return matches;
+}
+
+std::vector<std::size_t> CoincidenceAnalysis::run() {
+  rates.clear();
+  for (std::size_t t = kMinPeriod; t <= kMaxPeriod; t++) {
+    if (t >= symbols.size()) {
+      continue;
+    }
+    rates.emplace_back(t, (double)count_matches(t) / (symbols.size() - t));
+  }
+
+  // Stable, so that ties go to the shorter period
+  std::stable_sort(rates.begin(), rates.end(), sortByVal);
+  TRACE_DEBUG(kCoincidenceRates);
+  for (auto r : rates) {
+    TRACE_DEBUG(kCoincidenceRate, r.first, r.second);
+  }
+  TRACE_DEBUG(kEndLine);
+
+  std::vector<std::size_t> answer;
+  auto top = rates.begin() + std::min<std::size_t>(3, rates.size());
+  for (auto it = rates.begin(); it != top; it++) {
+    answer.push_back((*it).first);
+  }
+  return answer;
+}
+
+std::vector<std::size_t> CoincidenceAnalysis::ranking() const {
+  std::vector<std::size_t> periods;
+  for (auto r : rates) {
+    periods.push_back(r.first);
+  }
+  return periods;
+}
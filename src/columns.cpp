@@ -0,0 +1,128 @@
+#include "columns.h"
+
+#include <algorithm>
+#include <future>
+#include <numeric>
+
+#include "trace.h"
+
+static_assert(ColumnScoring::kWindow <= 32,
+              "The agreements of a window are the bits of a word");
+
+ColumnScoring::ColumnScoring(const Encoded &cipher_stream,
+                             std::shared_ptr<const CandidateStreams> candidates,
+                             std::vector<std::size_t> key_lengths)
+    : candidates(std::move(candidates)), key_lengths(std::move(key_lengths)) {
+  this->key_lengths.erase(
+      std::remove(this->key_lengths.begin(), this->key_lengths.end(), 0),
+      this->key_lengths.end());
+
+  PackedStream cipher = pack(cipher_stream);
+  for (std::size_t t : this->key_lengths) {
+    std::vector<std::uint8_t> column;
+    for (std::size_t i = 0; i + t < cipher.size(); i++) {
+      column.push_back(DefaultAlphabet::diff(cipher[i], cipher[i + t]));
+    }
+    column_diffs.push_back(std::move(column));
+  }
+}
+
+ColumnScore ColumnScoring::score_plaintext(std::size_t p) const {
+  const std::uint32_t kWindowMask =
+      kWindow == 32 ? ~0u : (std::uint32_t(1) << kWindow) - 1;
+  const std::uint8_t *plain = candidates->row(p);
+  const std::size_t plain_length = candidates->length(p);
+
+  ColumnScore best;
+  std::vector<std::uint8_t> plain_column;
+  for (std::size_t h = 0; h < key_lengths.size(); h++) {
+    const std::size_t t = key_lengths[h];
+    const std::vector<std::uint8_t> &cipher_column = column_diffs[h];
+    plain_column.clear();
+    for (std::size_t j = 0; j + t < plain_length; j++) {
+      plain_column.push_back(DefaultAlphabet::diff(plain[j], plain[j + t]));
+    }
+
+    // Agreements of the last kWindow pairs at shift + b, one bit per pair,
+    // newest in bit 0, and their number
+    std::uint32_t window[kBand + 1] = {};
+    int counts[kBand + 1] = {};
+    std::size_t shift = 0;
+    std::size_t agreements = 0;
+    std::size_t pairs = 0;
+    for (std::size_t j = 0; j < plain_column.size() &&
+                            j + shift + kBand < cipher_column.size();
+         j++) {
+      const std::uint8_t *at = cipher_column.data() + j + shift;
+      for (std::size_t b = 0; b <= kBand; b++) {
+        std::uint32_t agree = at[b] == plain_column[j];
+        counts[b] += agree - (window[b] >> (kWindow - 1));
+        window[b] = ((window[b] << 1) | agree) & kWindowMask;
+      }
+      agreements += window[0] & 1;
+      pairs++;
+
+      // Resynchronize to the shift that leads the tracked one by the margin
+      std::size_t lead = 0;
+      for (std::size_t b = 1; b <= kBand; b++) {
+        if (counts[b] >= counts[lead] + (int)kResyncMargin) {
+          lead = b;
+        }
+      }
+      if (lead > 0) {
+        shift += lead;
+        std::fill(std::begin(window), std::end(window), 0);
+        std::fill(std::begin(counts), std::end(counts), 0);
+      }
+    }
+
+    float score = pairs == 0 ? 0.0f : (float)agreements / pairs;
+    if (score > best.score) {
+      best = ColumnScore{score, t};
+    }
+  }
+  return best;
+}
+
+std::vector<ColumnScore> ColumnScoring::scores(ThreadPool *pool) const {
+  const std::size_t n_plains = candidates->size();
+  std::vector<ColumnScore> result(n_plains);
+  if (pool == nullptr) {
+    for (std::size_t p = 0; p < n_plains; p++) {
+      result[p] = score_plaintext(p);
+    }
+    return result;
+  }
+
+  std::vector<std::future<ColumnScore>> futures;
+  futures.reserve(n_plains);
+  for (std::size_t p = 0; p < n_plains; p++) {
+    futures.push_back(pool->submit([this, p]() { return score_plaintext(p); }));
+  }
+  for (std::size_t p = 0; p < n_plains; p++) {
+    result[p] = pool->wait(futures[p]);
+  }
+  return result;
+}
+
+std::optional<std::size_t> ColumnScoring::run(ThreadPool *pool) const {
+  auto all = scores(pool);
+  for (std::size_t p = 0; p < all.size(); p++) {
+    TRACE_DEBUG(kColumnScore, p + 1, all[p].score, all[p].key_length);
+  }
+  if (all.size() < 2) {
+    return std::nullopt;
+  }
+
+  std::vector<std::size_t> order(all.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::partial_sort(order.begin(), order.begin() + 2, order.end(),
+                    [&all](std::size_t a, std::size_t b) {
+                      return all[a].score > all[b].score;
+                    });
+  const ColumnScore &best = all[order[0]];
+  if (best.score == 0.0f || best.score < kMinRatio * all[order[1]].score) {
+    return std::nullopt;
+  }
+  return order[0];
+}
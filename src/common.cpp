@@ -1,25 +1,27 @@
 #include "common.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <iterator>
 #include <utility>
 
 // `L`: short for msg_length
 // `t`: short for key_length
-int diff(int c, int p) {
-  int d = c - p;
-  if (d < 0) {
-    d += 27;
+
+std::string strip_line_end(std::string line) {
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
   }
-  return d;
+  return line;
 }
 
-int ctoi(char c) {
-  assert((c == ' ') | ('a' < c) | (c < 'z'));
-  if (c == ' ') {
-    return 0;
-  }
-  return (c - 'a' + 1);
+std::string alphabet_only(std::string_view text) {
+  std::string result;
+  result.reserve(text.size());
+  std::copy_if(text.begin(), text.end(), std::back_inserter(result),
+               [](char c) { return DefaultAlphabet::contains(c); });
+  return result;
 }
 
 bool sortByVal(const std::pair<std::size_t, double> &a,
@@ -27,52 +29,84 @@ bool sortByVal(const std::pair<std::size_t, double> &a,
   return (a.second > b.second);
 }
 
-char forward(char m, int amount) {
-  amount %= 27;
-  if (m == ' ') {
-    if (amount == 0) {
-      return ' ';
-    } else {
-      return ('a' + amount);
+void reduce_key_period(std::vector<int> &key) {
+  for (std::size_t p = 1; p < key.size(); p++) {
+    if (key.size() % p != 0) {
+      continue;
+    }
+    bool periodic = true;
+    for (std::size_t j = p; j < key.size() && periodic; j++) {
+      periodic = (key[j] == key[j % p]);
+    }
+    if (periodic) {
+      key.resize(p);
+      return;
     }
   }
+}
 
-  return (m - 'a' + amount) % 27 + 'a';
+char forward(char m, int amount) {
+  return DefaultAlphabet::character(
+      DefaultAlphabet::shift(DefaultAlphabet::symbol(m), amount));
 }
 
-Combination::Combination(std::size_t _n, std::size_t _k) {
-  n = _n;
-  k = _k;
+Combination::Combination(std::size_t n, std::size_t k)
+    : Combination(n, k, 0, binomial(n, k)) {}
 
-  std::size_t end_ = 1;
-  state = std::vector<std::size_t>(k);
+Combination::Combination(std::size_t n, std::size_t k, std::uint64_t first,
+                         std::uint64_t end)
+    : n(n), k(k), state(k), first(first), end(end), current(first) {
+  assert(k > 0);
+  assert(first <= end && end <= binomial(n, k));
+  if (first < end) {
+    unrank(n, k, first, state.data());
+  }
+}
 
+std::uint64_t Combination::binomial(std::size_t n, std::size_t k) {
+  if (k > n) {
+    return 0;
+  }
+  k = std::min(k, n - k);
+  // C(n, i + 1) = C(n, i) * (n - i) / (i + 1) is exact at every step
+  unsigned __int128 c = 1;
   for (std::size_t i = 0; i < k; i++) {
-    end_ *= _n;
-    end_ /= (i + 1);
-    _n -= 1;
-
-    state[i] = i;
+    c = c * (n - i) / (i + 1);
+    assert(c <= UINT64_MAX);
   }
-
-  end = end_;
+  return (std::uint64_t)c;
 }
 
-// Reference: https://stackoverflow.com/a/39876710
-std::optional<std::vector<std::size_t>> Combination::next() {
-  if (current == end) return std::nullopt;
-
-  auto comb = std::make_optional(state);
-
-  std::vector<size_t>::iterator last = state.end() - 1;
-
-  while ((last != state.begin()) && (*(last) == n - (state.end() - last))) {
-    last--;
+// Combinadic: the complement n-1-c[i] of a combination, read in reverse, is
+// a combination in colexicographic order, whose rank is a sum of binomials
+std::uint64_t Combination::rank(std::size_t n, std::size_t k,
+                                const std::size_t *c) {
+  std::uint64_t colex = 0;
+  for (std::size_t i = 0; i < k; i++) {
+    colex += binomial(n - 1 - c[i], k - i);
   }
-  (*last)++;
-  while (++last != state.end()) *last = *(last - 1) + 1;
+  return binomial(n, k) - 1 - colex;
+}
 
-  current += 1;
+void Combination::unrank(std::size_t n, std::size_t k, std::uint64_t r,
+                         std::size_t *out) {
+  assert(r < binomial(n, k));
+  std::uint64_t colex = binomial(n, k) - 1 - r;
+  std::size_t m = n;
+  for (std::size_t i = 0; i < k; i++) {
+    // Largest m with C(m, k - i) <= colex
+    do {
+      m--;
+    } while (binomial(m, k - i) > colex);
+    colex -= binomial(m, k - i);
+    out[i] = n - 1 - m;
+  }
+}
 
-  return comb;
+std::pair<std::uint64_t, std::uint64_t> Combination::chunk(
+    std::uint64_t total, std::size_t n_chunks, std::size_t i) {
+  auto bound = [&](std::size_t j) {
+    return (std::uint64_t)((unsigned __int128)total * j / n_chunks);
+  };
+  return {bound(i), bound(i + 1)};
 }
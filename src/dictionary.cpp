@@ -0,0 +1,170 @@
+#include "dictionary.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "entropy.h"
+
+static std::uint64_t align_up(std::uint64_t n) {
+  return (n + kDictionaryAlignment - 1) / kDictionaryAlignment *
+         kDictionaryAlignment;
+}
+
+/// @brief A read-only shared mapping of a whole file, unmapped on destruction
+class MappedFile {
+ private:
+  void *address = MAP_FAILED;
+  std::size_t length = 0;
+
+ public:
+  explicit MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      length = st.st_size;
+      address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (address != MAP_FAILED) {
+      munmap(address, length);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool mapped() const { return address != MAP_FAILED; }
+  std::size_t size() const { return length; }
+  const std::uint8_t *data() const {
+    return static_cast<const std::uint8_t *>(address);
+  }
+};
+
+std::vector<std::string> read_corpus(const std::string &path) {
+  std::ifstream file(path);
+  std::vector<std::string> candidates;
+  std::string line;
+  while (std::getline(file, line)) {
+    line = strip_line_end(std::move(line));
+    if (line.empty() || line.rfind("Test", 0) == 0 ||
+        line.rfind("Candidate", 0) == 0) {
+      continue;
+    }
+    candidates.push_back(line);
+  }
+  return candidates;
+}
+
+bool compile_dictionary(const std::vector<std::string> &candidates,
+                        const std::string &path) {
+  if (candidates.empty()) {
+    std::cerr << "[DICT] No candidates to compile\n";
+    return false;
+  }
+  for (std::size_t p = 0; p < candidates.size(); p++) {
+    auto bad = std::find_if_not(candidates[p].begin(), candidates[p].end(),
+                                DefaultAlphabet::contains);
+    if (bad != candidates[p].end()) {
+      std::cerr << "[DICT] Candidate " << (p + 1) << " has '" << *bad
+                << "' at " << (bad - candidates[p].begin())
+                << ", outside the alphabet\n";
+      return false;
+    }
+  }
+
+  std::vector<std::uint64_t> lengths;
+  std::uint64_t longest = 1;
+  for (const auto &c : candidates) {
+    lengths.push_back(c.size());
+    longest = std::max<std::uint64_t>(longest, c.size());
+  }
+
+  DictionaryHeader header = {};
+  std::memcpy(header.magic, kDictionaryMagic, sizeof(header.magic));
+  header.version = kDictionaryVersion;
+  header.n_candidates = candidates.size();
+  header.stride = align_up(longest);
+  header.common_length = *std::min_element(lengths.begin(), lengths.end());
+  header.lengths_offset = align_up(sizeof(header));
+  header.rows_offset =
+      align_up(header.lengths_offset + lengths.size() * sizeof(std::uint64_t));
+
+  std::vector<char> image(header.rows_offset +
+                          header.n_candidates * header.stride);
+  std::memcpy(image.data(), &header, sizeof(header));
+  std::memcpy(image.data() + header.lengths_offset, lengths.data(),
+              lengths.size() * sizeof(std::uint64_t));
+  for (std::size_t p = 0; p < candidates.size(); p++) {
+    Encoded encoded = encode(candidates[p]);
+    std::copy(encoded.begin(), encoded.end(),
+              image.begin() + header.rows_offset + p * header.stride);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(image.data(), image.size());
+  out.close();
+  if (!out) {
+    std::cerr << "[DICT] Cannot write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<const CandidateStreams> load_dictionary(
+    const std::string &path) {
+  auto file = std::make_shared<MappedFile>(path);
+  if (!file->mapped()) {
+    std::cerr << "[DICT] Cannot map " << path << "\n";
+    return nullptr;
+  }
+
+  DictionaryHeader header;
+  if (file->size() < sizeof(header)) {
+    std::cerr << "[DICT] " << path << " is not a dictionary\n";
+    return nullptr;
+  }
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kDictionaryMagic, sizeof(header.magic)) != 0 ||
+      header.version != kDictionaryVersion) {
+    std::cerr << "[DICT] " << path << " is not a version "
+              << kDictionaryVersion << " dictionary\n";
+    return nullptr;
+  }
+
+  // Every section must lie within the file
+  std::uint64_t size = file->size();
+  bool valid = header.n_candidates > 0 && header.stride > 0 &&
+               header.common_length <= header.stride &&
+               header.lengths_offset % kDictionaryAlignment == 0 &&
+               header.rows_offset % kDictionaryAlignment == 0 &&
+               header.lengths_offset <= size &&
+               header.n_candidates <=
+                   (size - header.lengths_offset) / sizeof(std::uint64_t) &&
+               header.rows_offset <= size &&
+               header.n_candidates <=
+                   (size - header.rows_offset) / header.stride;
+  if (!valid) {
+    std::cerr << "[DICT] " << path << " is truncated or corrupt\n";
+    return nullptr;
+  }
+
+  const std::uint8_t *base = file->data();
+  return std::make_shared<const CandidateStreams>(
+      base + header.rows_offset,
+      reinterpret_cast<const std::uint64_t *>(base + header.lengths_offset),
+      header.n_candidates, header.stride, header.common_length,
+      std::move(file));
+}
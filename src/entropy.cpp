@@ -3,144 +3,166 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <future>
 #include <iostream>
+#include <map>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+
+#include "coincidence.h"
+#include "columns.h"
+#include "metrics.h"
+#include "periodicity.h"
+#include "removal.h"
+#include "removal_search.h"
+#include "trace.h"
+
+// remove_many_chars_with_fft_test in decryption.py: removal sets of up to
+// `kMaxRemovals` characters among the first `kRemovalWindow`, whose entropy
+// is `kRemovalStdMultiplier` std devs below the average
+static const std::size_t kRemovalWindow = 48;
+static const std::size_t kMaxRemovals = 4;
+static const float kRemovalStdMultiplier = 3.0f;
+static const std::size_t kRemovalStatSamples = 4096;
+static const std::size_t kPeriodicMinLength = 14;
 
-Encoded encode(const std::string &text) {
-  Encoded encoded;
-  encoded.reserve(text.length());
-  for (char c : text) {
-    encoded.push_back(ctoi(c));
+void print_encoded(const Encoded &encoded, std::size_t to) {
+  for (std::size_t i = 0; i < to; i++) {
+    TRACE_VERBOSE(kSymbol, encoded[i]);
   }
-  return encoded;
+  TRACE_VERBOSE(kEndLine);
 }
 
-Encoded diff_encoded(const Encoded &cipher, const Encoded &plain) {
-  assert(cipher.size() >= plain.size());
-  Encoded shift;
-  shift.reserve(plain.size());
-  for (std::size_t i = 0; i < plain.size(); i++) {
-    shift.push_back(diff(cipher[i], plain[i]));
+static void print_row(const std::uint8_t *row, std::size_t to) {
+  for (std::size_t i = 0; i < to; i++) {
+    TRACE_VERBOSE(kSymbol, row[i]);
   }
-  return shift;
+  TRACE_VERBOSE(kEndLine);
 }
 
-void print_encoded(const Encoded &encoded, std::size_t to) {
-  for (std::size_t i = 0; i < to; i++) {
-    std::cerr << std::setw(2) << std::setfill('0') << encoded[i] << " ";
+std::shared_ptr<const CandidateStreams> encode_candidates(
+    const std::vector<std::string> &plaintexts) {
+  std::vector<Encoded> plain_streams;
+  plain_streams.reserve(plaintexts.size());
+  for (const auto &p : plaintexts) {
+    plain_streams.push_back(encode(p));
   }
-  std::cerr << '\n';
+  return std::make_shared<const CandidateStreams>(plain_streams);
 }
 
 // Measure the difference from the given cipherstream and plainstreams
-std::vector<Encoded> EntropyAnalysis::measure_diffs(
-    const Encoded &cipher_stream) {
-  std::vector<Encoded> diffs;
-  for (auto &&ps : this->plain_streams) {
-    std::vector<int> shift;
-    assert(ps.size() <= cipher_stream.size());
-    for (size_t i = 0; i < ps.size(); i++) {
-      int d = diff(cipher_stream[i], ps[i]);
-      shift.push_back(d);
-    }
-    diffs.push_back(shift);
-  }
-
+std::vector<std::uint8_t> EntropyAnalysis::measure_diffs(
+    const Encoded &cipher_stream, std::size_t length) {
+  assert(length <= cipher_stream.size());
+  assert(length <= candidates->length());
+  PackedStream cipher = pack(cipher_stream);
+  std::vector<std::uint8_t> diffs(candidates->size() * length);
+  candidates->diffs(cipher.data(), length, diffs.data());
   return diffs;
 }
 
 EntropyAnalysis::EntropyAnalysis(std::string ciphertext,
-                                 std::vector<std::string> plaintexts,
+                                 const std::vector<std::string> &plaintexts,
                                  std::size_t search_space)
-    : ciphertext(ciphertext),
-      plaintexts(plaintexts),
-      search_space(search_space) {
-  std::cerr << "Entropy Analysis\n";
-  assert(plaintexts.size() == 5);
+    : EntropyAnalysis(std::move(ciphertext), encode_candidates(plaintexts),
+                      search_space) {}
+
+EntropyAnalysis::EntropyAnalysis(
+    std::string ciphertext, std::shared_ptr<const CandidateStreams> candidates,
+    std::size_t search_space)
+    : ciphertext(std::move(ciphertext)),
+      candidates(std::move(candidates)),
+      search_space(search_space != kAdaptive
+                       ? search_space
+                       : std::min(this->ciphertext.size(),
+                                  this->candidates->length()) /
+                             3),
+      adaptive(search_space == kAdaptive) {
+  TRACE_INFO(kEntropyStart);
+  assert(this->candidates->size() > 0);
 
   this->cipher_stream = encode(this->ciphertext);
 
   for (std::size_t it = 0; it != search_space; it++) {
     // print encoding number with width 2
-    std::cerr << std::setw(2) << std::setfill('0') << it << " ";
+    TRACE_VERBOSE(kSymbol, it);
   }
-  std::cerr << '\n';
+  TRACE_VERBOSE(kEndLine);
 
   print_encoded(cipher_stream, search_space);
-  for (const auto &p : this->plaintexts) {
-    std::vector<int> plain_stream = encode(p);
-    this->plain_streams.push_back(plain_stream);
-    print_encoded(plain_stream, search_space);
+  for (std::size_t p = 0; p < this->candidates->size(); p++) {
+    print_row(this->candidates->row(p),
+              std::min(search_space, this->candidates->length(p)));
   }
 }
 
 float EntropyAnalysis::compute_entropy(const Counter &counter) {
-  float ent = .0f;
-  int all_counts = 0;
-  for (auto cnt : counter) {
-    all_counts += cnt.second;
-  }
-  for (auto cnt : counter) {
-    float p = (float)cnt.second / (float)all_counts;
-    ent -= p * log(p);
-  }
-
-  return ent;
+  return counter.entropy();
 }
 
-Counter EntropyAnalysis::make_counter(std::vector<int>::iterator begin,
-                                      std::vector<int>::iterator end) {
+Counter EntropyAnalysis::make_counter(const std::uint8_t *begin,
+                                      const std::uint8_t *end) {
+  Histogram histogram{};
+  count_symbols(begin, end - begin, histogram);
   Counter counter;
-  for (auto it = begin; it != end; it++) {
-    counter[*it]++;
-  }
+  counter.assign(histogram.data());
   return counter;
 }
 
-std::vector<float> EntropyAnalysis::compute_entropy_trend(
-    Encoded::iterator diff_begin, Encoded::iterator diff_end, int initial) {
-  assert(diff_begin + initial <= diff_end);
-  std::vector<float> trend;
-
+void EntropyAnalysis::compute_entropy_trend(const std::uint8_t *diff_begin,
+                                            const std::uint8_t *diff_end,
+                                            int initial, float *trend) {
+  assert(diff_begin + initial < diff_end);
   Counter counter = make_counter(diff_begin, diff_begin + initial);
-  trend.push_back(compute_entropy(counter));
+  extend_entropy_trend(counter, diff_begin + initial, diff_end, trend);
+}
 
-  for (auto it = diff_begin + initial; it != diff_end - 1; it++) {
-    counter[*it]++;
-    trend.push_back(compute_entropy(counter));
+TrendsComparison::TrendsComparison(std::vector<float> trends,
+                                   std::size_t n_trends,
+                                   float std_dev_threshold = 0.9f)
+    : n_trends(n_trends),
+      length(n_trends == 0 ? 0 : trends.size() / n_trends),
+      trends(std::move(trends)),
+      avg(0.0f),
+      std_dev(0.0f),
+      std_dev_threshold(std_dev_threshold) {
+  assert(this->trends.size() == n_trends * length);
+  if (n_trends < 2) {
+    return;
   }
 
-  return trend;
+  if (pairwise()) {
+    measure_pairs();
+  } else {
+    measure_median_distances();
+  }
+  measure_stats();
 }
 
-TrendsComparison::TrendsComparison(std::vector<std::vector<float>> trends,
-                                   float std_dev_threshold = 0.9f)
-    : trends(trends), std_dev_threshold(std_dev_threshold) {
-  diff_measures.reserve(trends.size() * (trends.size() - 1));
+TrendsComparison::TrendsComparison(std::size_t n_trends,
+                                   std::vector<float> diff_measures,
+                                   std::vector<float> offsets,
+                                   float std_dev_threshold)
+    : n_trends(n_trends),
+      length(0),
+      diff_measures(std::move(diff_measures)),
+      offsets(std::move(offsets)),
+      avg(0.0f),
+      std_dev(0.0f),
+      std_dev_threshold(std_dev_threshold) {
+  assert(this->diff_measures.size() == this->offsets.size());
+  if (n_trends < 2) {
+    return;
+  }
+  measure_stats();
+}
+
+void TrendsComparison::measure_stats() {
   float trend_sum = 0.0f;
   float trend_sqr_sum = 0.0f;
-
-  auto comb_iterator = std::make_unique<Combination>(trends.size(), 2);
-  auto combination = comb_iterator->next();
-
-  while (combination.has_value()) {
-    std::vector<std::size_t> indicies = combination.value();
-    assert(indicies.size() == 2);
-    std::size_t i = indicies[0];
-    std::size_t j = indicies[1];
-    std::vector<float> trend_i = trends[i];
-    std::vector<float> trend_j = trends[j];
-    float trend_diff = 0.0f;
-    for (size_t k = 0; k < trend_i.size(); k++) {
-      trend_diff += (trend_i[k] - trend_j[k]) * (trend_i[k] - trend_j[k]);
-    }
-    // std::cerr << "- " << i << " " << j << " " << trend_diff << std::endl;
-    diff_measures.push_back(trend_diff);
+  for (float trend_diff : diff_measures) {
     trend_sum += trend_diff;
     trend_sqr_sum += trend_diff * trend_diff;
-
-    combination = comb_iterator->next();
   }
 
   float trend_avg = trend_sum / (float)diff_measures.size();
@@ -150,193 +172,496 @@ TrendsComparison::TrendsComparison(std::vector<std::vector<float>> trends,
 
   this->avg = trend_avg;
   this->std_dev = trend_std;
-  std::cerr << "[TRND] Trend Difference: avg=" << trend_avg
-            << " std_dev=" << trend_std << std::endl;
+  TRACE_DEBUG(kTrendStats, trend_avg, trend_std);
 }
 
-std::optional<size_t> TrendsComparison::detect_anomaly() {
-  if (this->std_dev < this->std_dev_threshold) {
-    std::cerr << "[ANOM] Anomaly detection failed: std_dev is too small\n";
-    return std::nullopt;
+// Squared distances of all pairs, a row against a block of the rows after it
+// at a time. The matrix is transposed first so that the block of each column
+// is contiguous, and the distances of a block accumulate side by side; each
+// one still sums its terms in trend order.
+void TrendsComparison::measure_pairs() {
+  static const std::size_t kBlock = 16;
+
+  std::vector<float> columns(length * n_trends);
+  for (std::size_t p = 0; p < n_trends; p++) {
+    for (std::size_t k = 0; k < length; k++) {
+      columns[k * n_trends + p] = trend(p)[k];
+    }
   }
 
-  std::vector<std::size_t> anomaly_indices;
-  auto comb_iterator = std::make_unique<Combination>(trends.size(), 2);
-
-  assert(this->diff_measures.size() == comb_iterator->size());
-
-  for (auto diff = diff_measures.begin(); diff != diff_measures.end(); diff++) {
-    std::vector<std::size_t> indices = comb_iterator->next().value();
-    if (*diff > this->avg + 0.25 * this->std_dev) {
-      std::size_t i = indices[0];
-      std::size_t j = indices[1];
-      float trend_L1_diff = 0.0f;
-      for (size_t k = 0; k < trends[i].size(); k++) {
-        trend_L1_diff += trends[i][k] - trends[j][k];
-      }
-      std::cerr << "[ANOM] Anomaly detected: " << indices[0] << " "
-                << indices[1] << " " << *diff << std::endl;
-      if (trend_L1_diff > 0.0f) {
-        anomaly_indices.push_back(j);
-      } else {
-        anomaly_indices.push_back(i);
+  diff_measures.resize(n_trends * (n_trends - 1) / 2);
+  offsets.resize(diff_measures.size());
+  float *out = diff_measures.data();
+  float *out_offsets = offsets.data();
+  for (std::size_t i = 0; i < n_trends; i++) {
+    const float *trend_i = trend(i);
+    for (std::size_t j0 = i + 1; j0 < n_trends; j0 += kBlock) {
+      const std::size_t width = std::min(kBlock, n_trends - j0);
+      float block[kBlock] = {};
+      float block_offsets[kBlock] = {};
+      for (std::size_t k = 0; k < length; k++) {
+        const float *column = columns.data() + k * n_trends + j0;
+        for (std::size_t jj = 0; jj < width; jj++) {
+          float d = trend_i[k] - column[jj];
+          block[jj] += d * d;
+          block_offsets[jj] += d;
+        }
       }
+      out = std::copy(block, block + width, out);
+      out_offsets =
+          std::copy(block_offsets, block_offsets + width, out_offsets);
     }
   }
+}
 
-  std::unordered_map<std::size_t, std::size_t>
-      ai_count;  // anomaly indices count
-
-  for (auto i : anomaly_indices) {
-    ai_count[i]++;
-  }
-
-  int most_frequent = -1;
-  std::size_t max_count = 0;
-  for (const auto &i_cnt : ai_count) {
-    if (i_cnt.second > max_count) {
-      max_count = i_cnt.second;
-      most_frequent = i_cnt.first;
+// Squared distance and signed offset of every trend from the median trend,
+// whose k-th entry is the median of the k-th entries of all trends
+void TrendsComparison::measure_median_distances() {
+  std::vector<float> median(length);
+  std::vector<float> column(n_trends);
+  const std::size_t mid = n_trends / 2;
+  for (std::size_t k = 0; k < length; k++) {
+    for (std::size_t p = 0; p < n_trends; p++) {
+      column[p] = trend(p)[k];
+    }
+    std::nth_element(column.begin(), column.begin() + mid, column.end());
+    median[k] = column[mid];
+    if (n_trends % 2 == 0) {
+      float below = *std::max_element(column.begin(), column.begin() + mid);
+      median[k] = (median[k] + below) / 2.0f;
     }
   }
 
-  // Is the most frequent index uninque?
-  int mf_count = 0;
-  for (const auto &i_cnt : ai_count) {
-    if (i_cnt.second == max_count) {
-      mf_count++;
+  diff_measures.resize(n_trends);
+  offsets.resize(n_trends);
+  for (std::size_t p = 0; p < n_trends; p++) {
+    const float *trend_p = trend(p);
+    float distance = 0.0f;
+    float offset = 0.0f;
+    for (std::size_t k = 0; k < length; k++) {
+      float d = trend_p[k] - median[k];
+      distance += d * d;
+      offset += d;
     }
+    diff_measures[p] = distance;
+    offsets[p] = offset;
   }
+}
 
-  if (mf_count != 1) {
-    std::cerr << "[ANOM] Most frequent index is not unique\n";
+std::optional<size_t> TrendsComparison::detect_anomaly() {
+  if (this->std_dev < this->std_dev_threshold) {
+    TRACE_DEBUG(kAnomalyLowStdDev);
     return std::nullopt;
   }
 
-  return std::optional<size_t>(most_frequent);
-}
-
-std::string EntropyAnalysis::char_removed_at(const std::string &s, size_t i) {
-  if (i >= s.size()) {
-    return s;
+  if (pairwise()) {
+    return detect_pair_anomaly();
   }
-  auto result = s.substr(0, i) + s.substr(i + 1);
-  return result;
+  return detect_median_anomaly();
 }
 
-std::string EntropyAnalysis::optimize_entropy_for(
-    const std::string &plaintext, std::size_t expected_randoms) {
-  const Encoded plain_stream = encode(plaintext);
+std::optional<size_t> TrendsComparison::detect_pair_anomaly() {
+  // Votes of the distant pairs for their lower trend
+  std::vector<std::size_t> ai_count(n_trends, 0);
 
-  Encoded orig_diff = diff_encoded(this->cipher_stream, plain_stream);
-  float start_ent = compute_entropy(
-      make_counter(orig_diff.begin(), orig_diff.begin() + search_space));
+  auto diff = diff_measures.begin();
+  auto offset = offsets.begin();
+  for (std::size_t i = 0; i < n_trends; i++) {
+    for (std::size_t j = i + 1; j < n_trends; j++, diff++, offset++) {
+      if (*diff <= this->avg + 0.25 * this->std_dev) {
+        continue;
+      }
+      TRACE_DEBUG(kAnomalyPair, i, j, *diff);
+      if (*offset > 0.0f) {
+        ai_count[j]++;
+      } else {
+        ai_count[i]++;
+      }
+    }
+  }
 
-  std::cerr << "[OPT] Optimizing a ciphertext with entropy " << start_ent
-            << "\n";
+  auto max_count = std::max_element(ai_count.begin(), ai_count.end());
+  // Is the most frequent index uninque?
+  if (*max_count == 0 ||
+      std::count(ai_count.begin(), ai_count.end(), *max_count) != 1) {
+    TRACE_DEBUG(kAnomalyNotUnique);
+    return std::nullopt;
+  }
 
-  // First, try to remove a single character from the ciphertext
-  float prev_ent = 1000.0f;
-  std::size_t min_ci = 0;
+  margin = (float)*max_count / (float)(n_trends - 1);
 
-  std::string new_cipher = this->ciphertext;
-  std::size_t cursor = 0;
+  return std::optional<size_t>(max_count - ai_count.begin());
+}
 
-  for (std::size_t n_removed = 0; n_removed < expected_randoms; n_removed++) {
-    for (std::size_t ci = cursor; ci < search_space; ci++) {
-      std::string test_cipher = char_removed_at(new_cipher, ci);
-      Encoded new_cipher_stream = encode(test_cipher);
-      Encoded new_diff = diff_encoded(new_cipher_stream, plain_stream);
-      Counter cntr =
-          make_counter(new_diff.begin(), new_diff.begin() + search_space);
-      float ent = compute_entropy(cntr);
+std::optional<size_t> TrendsComparison::detect_median_anomaly() {
+  // The farthest trend below the median, if it is distant and alone
+  std::optional<size_t> farthest;
+  bool unique = false;
+  float runner_up = 0.0f;
+  for (std::size_t p = 0; p < n_trends; p++) {
+    if (offsets[p] >= 0.0f ||
+        diff_measures[p] <= this->avg + 0.25 * this->std_dev) {
+      continue;
+    }
+    if (!farthest.has_value() || diff_measures[p] > diff_measures[*farthest]) {
+      if (farthest.has_value()) {
+        runner_up = diff_measures[*farthest];
+      }
+      farthest = p;
+      unique = true;
+    } else {
+      runner_up = std::max(runner_up, diff_measures[p]);
+      if (diff_measures[p] == diff_measures[*farthest]) {
+        unique = false;
+      }
+    }
+  }
 
-      std::cerr << "[OPT] " << ci << ' ' << std::setprecision(10) << ent
-                << '\n';
+  if (!farthest.has_value() || !unique) {
+    TRACE_DEBUG(kAnomalyNoMedian);
+    return std::nullopt;
+  }
+  TRACE_DEBUG(kAnomalyMedian, *farthest, diff_measures[*farthest]);
+  margin = 1.0f - runner_up / diff_measures[*farthest];
+  return farthest;
+}
 
-      if (ent > prev_ent) {
-        min_ci = ci - 1;
-        prev_ent = ent;
-        break;
+std::optional<std::size_t> EntropyAnalysis::search_removal_sets() {
+  for (std::size_t pi = 0; pi < candidates->size(); pi++) {
+    if (cipher_stream.size() < kRemovalWindow + kMaxRemovals ||
+        candidates->length(pi) < kRemovalWindow) {
+      continue;
+    }
+    ShiftedDiffs diffs(cipher_stream, candidates->row(pi), kRemovalWindow,
+                       kMaxRemovals);
+
+    for (std::size_t n_remove = 2; n_remove <= kMaxRemovals; n_remove++) {
+      RemovalSetSearch search(diffs, n_remove);
+      auto stats = search.entropy_stats(kRemovalStatSamples);
+      float threshold = stats.first - kRemovalStdMultiplier * stats.second;
+
+      auto removal_sets = search.below(threshold, pool);
+      TRACE_DEBUG(kRemovalSets, pi + 1, removal_sets.size(), n_remove,
+                  threshold);
+
+      for (const auto &removed : removal_sets) {
+        if (has_periodic_prefix(search.diffs_without(removed),
+                                kPeriodicMinLength)) {
+          TRACE_INFO(kRemovalPeriodic);
+          for (auto r : removed) {
+            TRACE_INFO(kItem, r);
+          }
+          TRACE_INFO(kEndLine);
+          return pi;
+        }
       }
-
-      prev_ent = ent;
     }
-    std::cerr << "[OPT] min_ent=" << prev_ent << " min_ci=" << min_ci << "\n";
-    new_cipher = char_removed_at(new_cipher, min_ci);
-    cursor = min_ci + 1;
   }
 
-  return new_cipher;
+  return std::nullopt;
 }
 
 std::shared_ptr<TrendsComparison> EntropyAnalysis::entropy_trend_analysis(
     const Encoded &cipher_stream, std::size_t trend_start,
     float std_dev_threshold) {
-  std::vector<std::vector<float>> trends;
-  std::vector<Encoded> diffs = measure_diffs(cipher_stream);
-  for (auto d : diffs) {
-    std::vector<float> trend = compute_entropy_trend(
-        d.begin(), d.begin() + trend_start * 3, trend_start);
-    trends.push_back(trend);
+  const std::size_t length = trend_start * 3;
+  const std::size_t trend_length = length - trend_start;
+  const std::size_t n_trends = candidates->size();
+  std::vector<std::uint8_t> diffs = measure_diffs(cipher_stream, length);
+  std::vector<float> trends(n_trends * trend_length);
+  for (std::size_t p = 0; p < n_trends; p++) {
+    const std::uint8_t *d = diffs.data() + p * length;
+    compute_entropy_trend(d, d + length, trend_start,
+                          trends.data() + p * trend_length);
   }
 
-  auto trends_comparison =
-      std::make_shared<TrendsComparison>(trends, std_dev_threshold);
+  auto trends_comparison = std::make_shared<TrendsComparison>(
+      std::move(trends), n_trends, std_dev_threshold);
   return trends_comparison;
 }
 
+namespace {
+
+/// @brief Entropies of the growing prefixes of the diffs against every
+/// candidate.
+///
+/// The trend of search space s is the entropies of the prefixes s .. 3s - 1,
+/// whatever the window, so a larger window only extends the counters of the
+/// smaller one by its new diffs and reuses every entropy computed so far.
+class PrefixEntropies {
+ private:
+  const PackedStream cipher;
+  const CandidateStreams &candidates;
+
+  /// @brief Counter p holds the first entropies[p].size() - 1 diffs
+  std::vector<Counter> counters;
+
+  /// @brief entropies[p][n]: entropy of the first n diffs against p
+  std::vector<std::vector<float>> entropies;
+
+  std::vector<std::uint8_t> diffs;
+
+ public:
+  PrefixEntropies(const Encoded &cipher_stream,
+                  const CandidateStreams &candidates)
+      : cipher(pack(cipher_stream)),
+        candidates(candidates),
+        counters(candidates.size()),
+        entropies(candidates.size(), std::vector<float>{0.0f}) {}
+
+  // Entropies of the prefixes up to `length` - 1 diffs
+  void extend(std::size_t length) {
+    std::size_t known = entropies[0].size();
+    if (length <= known) {
+      return;
+    }
+    assert(length - 1 <= cipher.size() && length - 1 <= candidates.length());
+    diffs.resize(length - known);
+    for (std::size_t p = 0; p < candidates.size(); p++) {
+      diff_streams(cipher.data() + known - 1, candidates.row(p) + known - 1,
+                   diffs.data(), diffs.size());
+      for (std::uint8_t d : diffs) {
+        counters[p].add(d);
+        entropies[p].push_back(counters[p].entropy());
+      }
+    }
+  }
+
+  // The trends of search space `trend_start`, as entropy_trend_analysis
+  // computes them; extend(3 * trend_start) first
+  std::vector<float> trends(std::size_t trend_start) const {
+    const std::size_t trend_length = 2 * trend_start;
+    std::vector<float> result;
+    result.reserve(candidates.size() * trend_length);
+    for (const auto &e : entropies) {
+      assert(e.size() >= trend_start + trend_length);
+      result.insert(result.end(), e.begin() + trend_start,
+                    e.begin() + trend_start + trend_length);
+    }
+    return result;
+  }
+};
+
+// Outcome of the trend analysis of one optimized ciphertext
+struct TrendResult {
+  float std_dev = 0.0f;
+  std::optional<std::size_t> anomaly;
+};
+
+/// @brief Trend analyses of the optimized ciphertexts of one run, by removal
+/// set: the same removals give the same ciphertext, whichever plaintext and
+/// round the optimizer was at. A set analyzed by another thread is waited
+/// for rather than analyzed twice.
+class TrendCache {
+ private:
+  std::mutex mutex;
+  std::map<std::vector<std::size_t>, std::shared_future<TrendResult>> results;
+
+ public:
+  template <typename Analyze>
+  TrendResult get(const std::vector<std::size_t> &removed, Analyze analyze) {
+    std::promise<TrendResult> promise;
+    std::shared_future<TrendResult> cached;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto [it, inserted] = results.try_emplace(removed);
+      if (inserted) {
+        it->second = promise.get_future().share();
+      } else {
+        cached = it->second;
+      }
+    }
+    if (cached.valid()) {
+      TRACE_DEBUG(kEntropyCached, removed.size());
+      return cached.get();
+    }
+    TrendResult result = analyze();
+    promise.set_value(result);
+    return result;
+  }
+};
+
+}  // namespace
+
+std::size_t EntropyAnalysis::min_length(const CandidateStreams &candidates,
+                                        std::size_t search_space) {
+  std::size_t length = search_space * 3;
+  for (std::size_t p = 0; p < candidates.size(); p++) {
+    length = std::max(length, candidates.length(p));
+  }
+  return length;
+}
+
+std::optional<std::size_t> EntropyAnalysis::adaptive_first_pass() {
+  PrefixEntropies prefixes(cipher_stream, *candidates);
+  std::size_t trend_start = std::min(kMinSearchSpace, search_space);
+  while (true) {
+    TRACE_DEBUG(kEntropyResolution, trend_start);
+    prefixes.extend(trend_start * 3);
+    TrendsComparison comparison(prefixes.trends(trend_start),
+                                candidates->size(), 0.9f);
+    auto answer = comparison.detect_anomaly();
+    decided_search_space = trend_start;
+    if (answer.has_value() || trend_start == search_space) {
+      return answer;
+    }
+    trend_start = std::min(trend_start * 2, search_space);
+  }
+}
+
 std::optional<std::size_t> EntropyAnalysis::run() {
+  StageTimer run_timer(Stage::kEntropyRun);
+  auto decide = [this, &run_timer](Decision decision, std::size_t round = 0) {
+    metrics().record_decision(decision, run_timer.elapsed_ns(), round);
+    if (adaptive) {
+      metrics().record_search_space(decided_search_space);
+    }
+  };
+
   // Analyze the entropy difference on the first `search_space` character diffs
-  auto tc = entropy_trend_analysis(this->cipher_stream, search_space, 0.9f);
-  auto answer = tc->detect_anomaly();
+  StageTimer first_pass_timer(Stage::kFirstPass);
+  std::optional<std::size_t> answer;
+  if (adaptive) {
+    answer = adaptive_first_pass();
+  } else {
+    auto tc = entropy_trend_analysis(this->cipher_stream, search_space, 0.9f);
+    answer = tc->detect_anomaly();
+    decided_search_space = search_space;
+  }
+  first_pass_timer.stop();
   if (answer.has_value()) {
+    decide(Decision::kFirstPass);
     return answer;
   }
 
-  std::vector<std::string> optimized_ciphers;
-  std::vector<float> std_devs;
+  // In adaptive mode, the removals below search the smallest window: on
+  // generated ciphertexts, the larger ones decide no more ciphertexts, at
+  // several times the cost
+  const std::size_t window =
+      adaptive ? std::min(kMinSearchSpace, search_space) : search_space;
+  decided_search_space = window;
+
+  // Then look for a plaintext whose diffs repeat with some key length, over
+  // the whole ciphertext. Every length the coincidence analysis considers is
+  // scored: its three best guesses, or Kasiski's, miss the key length of
+  // about a third of the ciphertexts, and the rest only cost O(L) each.
+  StageTimer column_timer(Stage::kColumnScoring);
+  std::vector<std::size_t> key_lengths;
+  for (std::size_t t = CoincidenceAnalysis::kMinPeriod;
+       t <= CoincidenceAnalysis::kMaxPeriod; t++) {
+    key_lengths.push_back(t);
+  }
+  answer = ColumnScoring(cipher_stream, candidates, key_lengths).run(pool);
+  column_timer.stop();
+  if (answer.has_value()) {
+    decide(Decision::kColumnScore);
+    return answer;
+  }
 
   // If the entropy difference is not significant, try to reduce the entropy
-  // by removing characters.
-  std::size_t n_max_random = search_space * 0.05 * 1.5;
-  for (std::size_t n_random = 1; n_random <= n_max_random; n_random++) {
-    std::cerr << "[ENT] ----------------------------------------\n";
-    std::cerr << "[ENT] Expected number of random characters: " << n_random
-              << "\n";
-
-    for (std::size_t pi = 0; pi < 5; pi++) {
-      std::cerr << "[ENT] Optimization target= " << (pi + 1)
-                << "-th plaintext\n";
-      std::string opt_cipher = optimize_entropy_for(plaintexts[pi], n_random);
-      auto tc = entropy_trend_analysis(encode(opt_cipher), search_space, 0.9f);
-      auto anomaly = tc->detect_anomaly();
-      if (anomaly.has_value()) {
-        return anomaly;
+  // by removing characters. Every (n_random, plaintext) pair is a task, and
+  // the answer is the anomaly of the first task in (n_random, plaintext)
+  // order that finds one, exactly as if they ran one by one. Round n_random
+  // of a plaintext extends the removals of round n_random - 1, so the rounds
+  // of a plaintext run in order on one optimizer, and the plaintexts run in
+  // parallel.
+  const std::size_t n_plains = candidates->size();
+  const std::size_t n_max_random = window * 0.05 * 1.5;
+  const std::size_t n_tasks = n_max_random * n_plains;
+
+  std::vector<TrendResult> optimizations(n_tasks);
+  std::vector<std::unique_ptr<GreedyRemoval>> optimizers(n_plains);
+  TrendCache cache;
+  OrderedCancellation cancellation;
+  StageTimer optimize_timer(Stage::kOptimize);
+
+  // False once the task is cancelled, and with it the later rounds
+  auto optimize = [&](std::size_t task) {
+    if (cancellation.cancelled(task)) {
+      return false;
+    }
+    std::size_t n_random = task / n_plains + 1;
+    std::size_t pi = task % n_plains;
+    TRACE_DEBUG(kEntropyTarget, pi + 1, n_random);
+
+    auto &optimizer = optimizers[pi];
+    if (optimizer == nullptr) {
+      assert(window <= candidates->length(pi));
+      optimizer = std::make_unique<GreedyRemoval>(
+          cipher_stream, candidates->row(pi), window, n_max_random);
+    }
+    if (!optimizer->step(
+            [&cancellation, task]() { return cancellation.cancelled(task); })) {
+      return false;
+    }
+
+    TrendResult &result = optimizations[task];
+    result = cache.get(optimizer->removed(), [&]() {
+      auto tc = entropy_trend_analysis(optimizer->apply(cipher_stream),
+                                       window, 0.9f);
+      return TrendResult{tc->get_std_dev(), tc->detect_anomaly()};
+    });
+    if (result.anomaly.has_value()) {
+      cancellation.succeed(task);
+    }
+    return true;
+  };
+
+  if (pool == nullptr) {
+    for (std::size_t task = 0; task < n_tasks; task++) {
+      optimize(task);
+      if (cancellation.winner().has_value()) {
+        break;
       }
-      std_devs.push_back(tc->get_std_dev());
-      optimized_ciphers.push_back(opt_cipher);
+    }
+  } else {
+    std::vector<std::future<void>> futures;
+    futures.reserve(n_plains);
+    for (std::size_t pi = 0; pi < n_plains; pi++) {
+      futures.push_back(pool->submit([&optimize, n_tasks, n_plains, pi]() {
+        for (std::size_t task = pi; task < n_tasks; task += n_plains) {
+          if (!optimize(task)) {
+            return;
+          }
+        }
+      }));
+    }
+    for (auto &f : futures) {
+      pool->wait(f);
     }
   }
 
-  for (auto it = optimized_ciphers.begin(); it != optimized_ciphers.end();
-       it++) {
-    std::cerr << "[ENT] Trend anomaly test with "
-              << (it - optimized_ciphers.begin()) % 5
-              << "th optimized ciphertext\n";
-    auto tc = entropy_trend_analysis(encode((*it)), search_space, 0.9f);
-    auto anomaly = tc->detect_anomaly();
-    if (anomaly.has_value()) {
-      return anomaly;
-    } else {
-      std_devs.push_back(tc->get_std_dev());
-    }
+  optimize_timer.stop();
+  auto winner = cancellation.winner();
+  if (winner.has_value()) {
+    decide(Decision::kOptimizeRound, winner.value() / n_plains + 1);
+    return optimizations[winner.value()].anomaly;
   }
 
+  // Every optimized ciphertext was analyzed once above, and none has an
+  // anomaly: fall back on the removal sets, then on the largest std dev
+  std::vector<float> std_devs;
+  for (const auto &opt : optimizations) {
+    std_devs.push_back(opt.std_dev);
+  }
+
+  StageTimer removal_timer(Stage::kRemovalSearch);
+  auto removal_answer = search_removal_sets();
+  removal_timer.stop();
+  if (removal_answer.has_value()) {
+    decide(Decision::kRemovalSet);
+    return removal_answer;
+  }
+
+  // Windows under 14 characters allow no random character, and have nothing
+  // optimized to fall back on
+  if (std_devs.empty()) {
+    return std::nullopt;
+  }
   auto max_std = std::max_element(std_devs.begin(), std_devs.end());
   auto max_std_i = max_std - std_devs.begin();
-  std::cerr << "[ENT] Answering with the ciphertext with the largest std dev ("
-            << *max_std << ")\n";
+  TRACE_INFO(kEntropyMaxStdDev, *max_std);
+  decide(Decision::kMaxStdDev);
 
   // auto final_guess_cipher = optimized_ciphers[max_std_i];
   // auto anomaly =
@@ -349,5 +674,5 @@ std::optional<std::size_t> EntropyAnalysis::run() {
 
   // return std::nullopt;
 
-  return std::make_optional(max_std_i % 5);
+  return std::make_optional(max_std_i % n_plains);
 }
@@ -0,0 +1,21 @@
+#include "entropy_counter.h"
+
+#include <cmath>
+
+int64_t EntropyTerms::clogc_slow(int c) {
+  if (c <= 1) {
+    return 0;
+  }
+  return (int64_t)std::llround((double)c * std::log((double)c) * kScale);
+}
+
+std::vector<int64_t> EntropyTerms::build_table() {
+  std::vector<int64_t> table(kTableSize);
+  for (int c = 0; c < kTableSize; c++) {
+    table[c] = clogc_slow(c);
+  }
+  return table;
+}
+
+const std::vector<int64_t> EntropyTerms::clogc_table =
+    EntropyTerms::build_table();
@@ -0,0 +1,46 @@
+#include "generator.h"
+
+#include <cassert>
+
+CipherGenerator::CipherGenerator(std::uint64_t seed, std::uint64_t stream) {
+  std::seed_seq seq{(std::uint32_t)seed, (std::uint32_t)(seed >> 32),
+                    (std::uint32_t)stream, (std::uint32_t)(stream >> 32)};
+  rng.seed(seq);
+}
+
+std::vector<int> CipherGenerator::random_key(std::size_t key_length) {
+  std::uniform_int_distribution<int> shift(0, kAlphabetSize - 1);
+  std::vector<int> key(key_length);
+  for (auto &k : key) {
+    k = shift(rng);
+  }
+  return key;
+}
+
+GeneratedCipher CipherGenerator::encrypt(const std::string &plaintext,
+                                         const std::vector<int> &key) {
+  assert(!key.empty());
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::uniform_int_distribution<int> symbol(0, kAlphabetSize - 1);
+
+  GeneratedCipher result;
+  result.ciphertext.reserve(plaintext.size() + plaintext.size() / 16);
+  std::size_t j = 0;
+  while (j < plaintext.size()) {
+    int c;
+    if (coin(rng) >= kCoinThreshold) {
+      c = DefaultAlphabet::shift(ctoi(plaintext[j]),
+                                 key[(j + 1) % key.size()]);
+      j++;
+    } else {
+      c = symbol(rng);
+      result.random_indices.push_back(result.ciphertext.size());
+    }
+    result.ciphertext.push_back(DefaultAlphabet::character(c));
+  }
+  return result;
+}
+
+std::size_t CipherGenerator::uniform(std::size_t n) {
+  return std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+}
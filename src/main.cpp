@@ -1,58 +1,166 @@
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <csignal>
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <set>
+#include <string>
 
+#include "batch.h"
 #include "common.h"
+#include "dictionary.h"
 #include "entropy.h"
-#include "kasiski.h"
+#include "metrics.h"
+#include "online.h"
+#include "recovery.h"
+#include "server.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "words.h"
 
-static std::vector<std::string> parse_dict1();
 static std::vector<std::string> parse_dict2();
+static std::shared_ptr<const CandidateStreams> load_candidates(
+    const std::string& dict_path);
+static int run_batch(int argc, char* argv[]);
+static int run_stream(int argc, char* argv[]);
+static int run_serve(int argc, char* argv[]);
+
+// A search space argument: a number of characters, or "auto" for the adaptive
+// mode of EntropyAnalysis
+static int parse_search_space(const std::string& arg) {
+  return arg == "auto" ? (int)EntropyAnalysis::kAdaptive : atoi(arg.c_str());
+}
 
 int main(int argc, char* argv[]) {
   std::string ciphertext;
 
   if (argc < 3) {
     std::cout << "Usage: main <1|2> <search_space> \n";
+    std::cout << "       main batch <search_space> [<dir|glob|file|->] "
+                 "[-j <workers>] [--metrics <file>] [--dict <file>]\n";
+    std::cout << "       main stream <search_space> [--dict <file>] "
+                 "[--min-confidence <c>]\n";
+    std::cout << "       main serve <search_space> [--socket <path>] "
+                 "[-j <workers>] [--batch-window <us>] [--metrics <file>] "
+                 "[--dict <file>]\n";
     std::cout << "1 for test 1, 2 for test 2\n";
     std::cout << "<search_space>: how many characters will be used for entropy "
-                 "analysis\n";
+                 "analysis, or auto to start with "
+              << EntropyAnalysis::kMinSearchSpace
+              << " and double them while the analysis is inconclusive (not "
+                 "for stream)\n";
+    std::cout << "batch: decide many test 1 ciphertexts at once, one per file "
+                 "or one per line of stdin (-)\n";
+    std::cout << "stream: decide test 1 ciphertexts, one per line of stdin, "
+                 "as they arrive: \"<line> <answer> <confidence> <symbols>\" "
+                 "as soon as a candidate stands out\n";
+    std::cout << "serve: answer test 1 requests framed as in protocol.h on a "
+                 "Unix socket, or on stdin and stdout without --socket, until "
+                 "SIGINT or SIGTERM\n";
+    std::cout << "--metrics: write the stage and decision metrics as JSON to "
+                 "<file> instead of stderr, at the end and on SIGUSR1\n";
+    std::cout << "--dict: map the candidates from a dictionary compiled by "
+                 "dictc instead of reading resources/plaintext1.txt\n";
     exit(2);
   }
 
   std::string test = argv[1];
 
+  if (test == "batch") {
+    return run_batch(argc, argv);
+  }
+  if (test == "stream") {
+    return run_stream(argc, argv);
+  }
+  if (test == "serve") {
+    return run_serve(argc, argv);
+  }
+
   // expand_factor is used to expand the search space
   // The expand_factor 1 means the initial search space is exactly the same as
   // the result of Kasiski analysis
-  int search_space = atoi(argv[2]);
+  int search_space = parse_search_space(argv[2]);
+
+  std::cout << "Input ciphertext:\n";
+  std::getline(std::cin, ciphertext);
+  ciphertext = strip_line_end(std::move(ciphertext));
 
   if (test == "2") {
-    std::cerr << "Not implemented yet\n";
+    std::vector<std::string> plainwords = parse_dict2();
+    WordAnalysis word_analysis(ciphertext, plainwords);
+    auto decryption = word_analysis.run();
+
+    if (decryption.has_value()) {
+      TRACE_INFO(kWordKey);
+      for (auto k : decryption->key) {
+        TRACE_INFO(kSignedItem, k);
+      }
+      TRACE_INFO(kEndLine);
+      trace_flush();
+      std::cout << "The ciphertext is encrypted from plaintext\n"
+                << decryption->plaintext << std::endl;
+      return 0;
+    }
+
+    trace_flush();
+    std::cout << "Cryptanalysis failed to find the plaintext\n";
     return 0;
   }
 
-  std::cout << "Input ciphertext:\n";
-  std::getline(std::cin, ciphertext);
+  std::vector<std::string> plaintexts =
+      read_corpus("resources/plaintext1.txt");
+  auto candidates = encode_candidates(plaintexts);
 
-  std::vector<std::string> plaintexts = parse_dict1();
-  std::vector<std::string> plainwords = parse_dict2();
-
-  // auto kasiski_analysis = new KasiskiAnalysis(ciphertext);
-  // auto factors = kasiski_analysis->run();
-  // delete kasiski_analysis;
+  // The same check as batch and serve: in the alphabet, and long enough for
+  // every candidate and for the search space
+  std::size_t min_length = EntropyAnalysis::min_length(
+      *candidates, (std::size_t)std::max(search_space, 0));
+  if (search_space < 0 ||
+      !EntropyAnalysis::analyzable(ciphertext, min_length)) {
+    std::cerr << "[MAIN] The ciphertext needs at least " << min_length
+              << " characters, all spaces and lowercase letters\n";
+    std::cout << "Cryptanalysis failed to find the plaintext\n";
+    return 1;
+  }
 
+  // No Kasiski or coincidence guesses: the column scoring of
+  // EntropyAnalysis::run already scores every key length they pick from
+  ThreadPool pool;
   auto entropy_analysis =
-      new EntropyAnalysis(ciphertext, plaintexts, search_space);
+      new EntropyAnalysis(ciphertext, candidates, search_space);
+  entropy_analysis->use_thread_pool(&pool);
   auto answer = entropy_analysis->run();
+  std::size_t decided_search_space = entropy_analysis->get_search_space();
   delete entropy_analysis;
+  trace_flush();
 
   if (answer.has_value()) {
     std::size_t anomaly = answer.value();
+
+    RecoveryAnalysis recovery_analysis(ciphertext, plaintexts[anomaly]);
+    auto recovery = recovery_analysis.run();
+    trace_flush();
+    if (recovery.has_value()) {
+      std::cout << "Key:";
+      for (auto k : recovery->key) {
+        std::cout << " " << k;
+      }
+      std::cout << "\nRandom characters at:";
+      for (auto i : recovery->random_indices) {
+        std::cout << " " << i;
+      }
+      std::cout << std::endl;
+    }
+
+    if (search_space == (int)EntropyAnalysis::kAdaptive) {
+      std::cout << "Decided at search space " << decided_search_space
+                << std::endl;
+    }
     std::cout << "The ciphertext is encrypted from plaintext " << (anomaly + 1)
               << std::endl;
     return 0;
@@ -62,22 +170,206 @@ int main(int argc, char* argv[]) {
   return 0;
 }
 
-static std::vector<std::string> parse_dict1() {
-  std::string line;
-  std::ifstream plain1("resources/plaintext1.txt");
-  std::vector<std::string> dict1;
+static int run_batch(int argc, char* argv[]) {
+  int search_space = parse_search_space(argv[2]);
+  std::string source = "-";
+  std::size_t n_workers = 0;
+  std::string metrics_path;
+  std::string dict_path;
+
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      n_workers = atoi(argv[++i]);
+    } else if (arg == "--metrics" && i + 1 < argc) {
+      metrics_path = argv[++i];
+    } else if (arg == "--dict" && i + 1 < argc) {
+      dict_path = argv[++i];
+    } else {
+      source = arg;
+    }
+  }
+
+  auto candidates = load_candidates(dict_path);
+  if (candidates == nullptr) {
+    return 1;
+  }
+
+  // Per-candidate diagnostics of concurrent analyses would only interleave
+  set_tracing(false);
+
+  std::ofstream metrics_file;
+  std::ostream *metrics_out = &std::cerr;
+  if (!metrics_path.empty()) {
+    metrics_file.open(metrics_path);
+    metrics_out = &metrics_file;
+  }
+  std::signal(SIGUSR1, [](int) { request_metrics_dump(); });
+
+  BatchAnalysis batch(candidates, search_space, n_workers);
+  batch.dump_metrics_to(metrics_out);
+  std::size_t n_done = batch.run(source, std::cout);
+  std::cerr << "[BATCH] Analyzed " << n_done << " ciphertexts\n";
+  metrics().write_json(*metrics_out);
+
+  return 0;
+}
+
+// Bytes read from stdin at a time, whatever the pipe holds up to that; a
+// ciphertext is one line, and may span any number of reads
+static const std::size_t kStreamChunk = 4096;
+
+static int run_stream(int argc, char* argv[]) {
+  int search_space = parse_search_space(argv[2]);
+  std::string dict_path;
+  float min_confidence = OnlineAnalysis::kMinConfidence;
 
-  std::getline(plain1, line);
-  for (size_t i = 0; i < 5; i++) {
-    for (size_t j = 0; j < 3; j++) {
-      std::getline(plain1, line);
+  for (int i = 3; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--dict") {
+      dict_path = argv[i + 1];
+    } else if (arg == "--min-confidence") {
+      min_confidence = atof(argv[i + 1]);
     }
-    std::getline(plain1, line);
-    dict1.push_back(line);
   }
-  plain1.close();
 
-  return dict1;
+  // The online analysis grows its trends as characters come in, so the
+  // adaptive mode starts from the smallest search space
+  if (search_space == (int)EntropyAnalysis::kAdaptive) {
+    search_space = EntropyAnalysis::kMinSearchSpace;
+  }
+  if (search_space < 0) {
+    std::cerr << "[STREAM] The search space must be positive or auto\n";
+    return 1;
+  }
+  auto candidates = load_candidates(dict_path);
+  if (candidates == nullptr) {
+    return 1;
+  }
+  set_tracing(false);
+  ThreadPool pool;
+
+  std::size_t line_no = 1;
+  auto analysis = std::make_unique<OnlineAnalysis>(candidates, search_space,
+                                                   min_confidence);
+  bool written = false;
+  auto write = [&](const std::optional<OnlineDecision>& decision) {
+    std::cout << line_no << ' ';
+    if (decision.has_value()) {
+      std::cout << (decision->candidate + 1) << ' ' << decision->confidence
+                << ' ' << decision->symbols;
+    } else {
+      std::cout << "- 0 " << analysis->size();
+    }
+    // Downstream sees every decision as soon as it is made
+    std::cout << std::endl;
+    written = true;
+  };
+
+  char buffer[kStreamChunk];
+  while (true) {
+    ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    std::string_view chunk(buffer, n);
+    while (true) {
+      std::size_t end = chunk.find('\n');
+      // The rest of a decided line is read but not analyzed
+      if (!written && analysis->feed(chunk.substr(0, end)).has_value()) {
+        write(analysis->decision());
+      }
+      if (end == std::string_view::npos) {
+        break;
+      }
+      chunk.remove_prefix(end + 1);
+      if (!written && analysis->size() > 0) {
+        write(analysis->finish(&pool));
+      }
+      line_no++;
+      analysis = std::make_unique<OnlineAnalysis>(candidates, search_space,
+                                                  min_confidence);
+      written = false;
+    }
+  }
+  if (!written && analysis->size() > 0) {
+    write(analysis->finish(&pool));
+  }
+  return 0;
+}
+
+static int run_serve(int argc, char* argv[]) {
+  int search_space = parse_search_space(argv[2]);
+  std::string socket_path;
+  std::size_t n_workers = 0;
+  long batch_window_us = 0;
+  std::string metrics_path;
+  std::string dict_path;
+
+  for (int i = 3; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--socket") {
+      socket_path = argv[i + 1];
+    } else if (arg == "-j") {
+      n_workers = atoi(argv[i + 1]);
+    } else if (arg == "--batch-window") {
+      batch_window_us = atol(argv[i + 1]);
+    } else if (arg == "--metrics") {
+      metrics_path = argv[i + 1];
+    } else if (arg == "--dict") {
+      dict_path = argv[i + 1];
+    }
+  }
+
+  auto candidates = load_candidates(dict_path);
+  if (candidates == nullptr || search_space < 0) {
+    return 1;
+  }
+  set_tracing(false);
+
+  std::ofstream metrics_file;
+  std::ostream* metrics_out = &std::cerr;
+  if (!metrics_path.empty()) {
+    metrics_file.open(metrics_path);
+    metrics_out = &metrics_file;
+  }
+
+  AnalysisServer server(candidates, search_space, n_workers);
+  server.set_batch_window(std::chrono::microseconds(batch_window_us));
+  server.dump_metrics_to(metrics_out);
+  if (socket_path.empty()) {
+    server.serve_stdio();
+  } else if (!server.listen_on(socket_path)) {
+    return 1;
+  }
+
+  // A client that hangs up is noticed on write, not by a signal
+  std::signal(SIGPIPE, SIG_IGN);
+  std::signal(SIGUSR1, [](int) {
+    request_metrics_dump();
+    AnalysisServer::interrupt();
+  });
+  std::signal(SIGINT, [](int) { AnalysisServer::request_stop(); });
+  std::signal(SIGTERM, [](int) { AnalysisServer::request_stop(); });
+
+  if (!socket_path.empty()) {
+    std::cerr << "[SERVE] Listening on " << socket_path << "\n";
+  }
+  std::size_t n_answered = server.run();
+  std::cerr << "[SERVE] Answered " << n_answered << " requests\n";
+  metrics().write_json(*metrics_out);
+  return 0;
+}
+
+static std::shared_ptr<const CandidateStreams> load_candidates(
+    const std::string& dict_path) {
+  if (dict_path.empty()) {
+    return encode_candidates(read_corpus("resources/plaintext1.txt"));
+  }
+  return load_dictionary(dict_path);
 }
 
 static std::vector<std::string> parse_dict2() {
@@ -88,7 +380,7 @@ static std::vector<std::string> parse_dict2() {
   std::getline(plain2, line);
   std::getline(plain2, line);
   while (std::getline(plain2, line)) {
-    dict2.push_back(line);
+    dict2.push_back(strip_line_end(std::move(line)));
   }
 
   plain2.close();
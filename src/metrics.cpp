@@ -0,0 +1,179 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+
+static const char *const kStageNames[] = {
+    "kasiski_run",    "entropy_run",    "first_pass",     "column_scoring",
+    "optimize",       "removal_search", "server_request",
+};
+
+static const char *const kDecisionNames[] = {
+    "first_pass", "column_score", "optimize_round", "removal_set",
+    "max_std_dev",
+};
+
+static_assert(sizeof(kStageNames) / sizeof(*kStageNames) ==
+                  (std::size_t)Stage::kCount,
+              "Every stage needs a name");
+static_assert(sizeof(kDecisionNames) / sizeof(*kDecisionNames) ==
+                  (std::size_t)Decision::kCount,
+              "Every decision needs a name");
+
+std::size_t LatencyHistogram::bucket(std::uint64_t ns) {
+  if (ns < kSubBuckets) {
+    return ns;
+  }
+  std::size_t msb = 63 - __builtin_clzll(ns);
+  std::size_t shift = msb - kSubBits;
+  std::size_t sub = (ns >> shift) - kSubBuckets;
+  return kSubBuckets + shift * kSubBuckets + sub;
+}
+
+std::uint64_t LatencyHistogram::bucket_value(std::size_t bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  std::size_t shift = (bucket - kSubBuckets) / kSubBuckets;
+  std::uint64_t sub = (bucket - kSubBuckets) % kSubBuckets;
+  std::uint64_t low = (kSubBuckets + sub) << shift;
+  return low + ((std::uint64_t(1) << shift) >> 1);
+}
+
+void LatencyHistogram::record(std::uint64_t ns) {
+  counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(ns, std::memory_order_relaxed);
+
+  std::uint64_t current = min.load(std::memory_order_relaxed);
+  while (ns < current &&
+         !min.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+  }
+  current = max.load(std::memory_order_relaxed);
+  while (ns > current &&
+         !max.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+  }
+}
+
+std::uint64_t LatencyHistogram::percentile(double q) const {
+  std::uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  std::uint64_t target = std::max<std::uint64_t>(1, std::ceil(q * n));
+  std::uint64_t seen = 0;
+  for (std::size_t b = 0; b < kBuckets; b++) {
+    seen += counts[b].load(std::memory_order_relaxed);
+    if (seen >= target) {
+      // The exact extremes are known
+      return std::min(std::max(bucket_value(b), min.load()), max.load());
+    }
+  }
+  return max.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::write_json(std::ostream &out) const {
+  std::uint64_t n = count();
+  out << "{\"count\": " << n;
+  if (n > 0) {
+    out << ", \"min_ns\": " << min.load(std::memory_order_relaxed)
+        << ", \"mean_ns\": " << sum.load(std::memory_order_relaxed) / n
+        << ", \"p50_ns\": " << percentile(0.5)
+        << ", \"p90_ns\": " << percentile(0.9)
+        << ", \"p99_ns\": " << percentile(0.99)
+        << ", \"p999_ns\": " << percentile(0.999)
+        << ", \"max_ns\": " << max.load(std::memory_order_relaxed);
+  }
+  out << "}";
+}
+
+void LatencyHistogram::clear() {
+  for (auto &c : counts) {
+    c.store(0, std::memory_order_relaxed);
+  }
+  total.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  min.store(UINT64_MAX, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
+
+void Metrics::record_decision(Decision decision, std::uint64_t ns,
+                              std::size_t round) {
+  decisions[(std::size_t)decision].record(ns);
+  if (decision == Decision::kOptimizeRound) {
+    rounds[std::min(round, kMaxRounds)].fetch_add(1,
+                                                  std::memory_order_relaxed);
+  }
+}
+
+void Metrics::record_search_space(std::size_t search_space) {
+  std::lock_guard<std::mutex> lock(search_spaces_mutex);
+  search_spaces[search_space]++;
+}
+
+void Metrics::write_json(std::ostream &out) const {
+  out << "{\n  \"stages\": {";
+  for (std::size_t s = 0; s < stages.size(); s++) {
+    out << (s == 0 ? "\n" : ",\n") << "    \"" << kStageNames[s] << "\": ";
+    stages[s].write_json(out);
+  }
+  out << "\n  },\n  \"decisions\": {";
+  for (std::size_t d = 0; d < decisions.size(); d++) {
+    out << (d == 0 ? "\n" : ",\n") << "    \"" << kDecisionNames[d] << "\": ";
+    decisions[d].write_json(out);
+  }
+  out << "\n  },\n  \"optimize_rounds\": {";
+  bool first = true;
+  for (std::size_t r = 0; r <= kMaxRounds; r++) {
+    std::uint64_t n = rounds[r].load(std::memory_order_relaxed);
+    if (n == 0) {
+      continue;
+    }
+    out << (first ? "" : ", ") << "\"" << r << (r == kMaxRounds ? "+" : "")
+        << "\": " << n;
+    first = false;
+  }
+  out << "},\n  \"search_spaces\": {";
+  {
+    std::lock_guard<std::mutex> lock(search_spaces_mutex);
+    first = true;
+    for (const auto &[search_space, n] : search_spaces) {
+      out << (first ? "" : ", ") << "\"" << search_space << "\": " << n;
+      first = false;
+    }
+  }
+  out << "}\n}\n";
+  out.flush();
+}
+
+void Metrics::clear() {
+  for (auto &h : stages) {
+    h.clear();
+  }
+  for (auto &h : decisions) {
+    h.clear();
+  }
+  for (auto &r : rounds) {
+    r.store(0, std::memory_order_relaxed);
+  }
+  std::lock_guard<std::mutex> lock(search_spaces_mutex);
+  search_spaces.clear();
+}
+
+Metrics &metrics() {
+  static Metrics instance;
+  return instance;
+}
+
+static volatile std::sig_atomic_t dump_requested = 0;
+
+void request_metrics_dump() { dump_requested = 1; }
+
+bool take_metrics_dump_request() {
+  if (dump_requested == 0) {
+    return false;
+  }
+  dump_requested = 0;
+  return true;
+}
@@ -0,0 +1,132 @@
+#include "online.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "entropy.h"
+#include "trace.h"
+
+OnlineAnalysis::OnlineAnalysis(
+    std::shared_ptr<const CandidateStreams> candidates,
+    std::size_t trend_start, float min_confidence)
+    : candidates(std::move(candidates)),
+      trend_start(trend_start),
+      min_confidence(min_confidence) {
+  const std::size_t n_trends = this->candidates->size();
+  assert(n_trends > 0 && trend_start > 0);
+  counters.resize(n_trends);
+  entropies.resize(n_trends);
+  std::size_t n_measures =
+      pairwise() ? n_trends * (n_trends - 1) / 2 : n_trends;
+  diff_measures.assign(n_measures, 0.0f);
+  offsets.assign(n_measures, 0.0f);
+}
+
+bool OnlineAnalysis::pairwise() const {
+  return candidates->size() <= TrendsComparison::kMaxPairwiseTrends;
+}
+
+const std::optional<OnlineDecision> &OnlineAnalysis::feed(
+    std::string_view chunk) {
+  for (char c : chunk) {
+    if (decided.has_value()) {
+      break;
+    }
+    if (DefaultAlphabet::contains(c)) {
+      ciphertext.push_back(c);
+      add(DefaultAlphabet::symbol(c));
+    }
+  }
+  return decided;
+}
+
+void OnlineAnalysis::add(int symbol) {
+  // Diffs go up to the end of the shortest candidate, as in EntropyAnalysis
+  const std::size_t i = ciphertext.size() - 1;
+  if (i >= candidates->length()) {
+    return;
+  }
+  for (std::size_t p = 0; p < counters.size(); p++) {
+    counters[p].add(DefaultAlphabet::diff(symbol, candidates->row(p)[i]));
+  }
+  if (i + 1 < trend_start) {
+    return;
+  }
+
+  // The trends are the entropies of the first trend_start + k diffs
+  for (std::size_t p = 0; p < counters.size(); p++) {
+    entropies[p] = counters[p].entropy();
+  }
+  if (pairwise()) {
+    measure_pairs();
+  } else {
+    measure_median_distances();
+  }
+  trend_length++;
+
+  if (trend_length >= trend_start && trend_length % kCheckInterval == 0) {
+    check();
+  }
+}
+
+void OnlineAnalysis::measure_pairs() {
+  const std::size_t n_trends = entropies.size();
+  std::size_t pair = 0;
+  for (std::size_t i = 0; i < n_trends; i++) {
+    for (std::size_t j = i + 1; j < n_trends; j++, pair++) {
+      float d = entropies[i] - entropies[j];
+      diff_measures[pair] += d * d;
+      offsets[pair] += d;
+    }
+  }
+}
+
+void OnlineAnalysis::measure_median_distances() {
+  const std::size_t n_trends = entropies.size();
+  const std::size_t mid = n_trends / 2;
+  column = entropies;
+  std::nth_element(column.begin(), column.begin() + mid, column.end());
+  float median = column[mid];
+  if (n_trends % 2 == 0) {
+    float below = *std::max_element(column.begin(), column.begin() + mid);
+    median = (median + below) / 2.0f;
+  }
+  for (std::size_t p = 0; p < n_trends; p++) {
+    float d = entropies[p] - median;
+    diff_measures[p] += d * d;
+    offsets[p] += d;
+  }
+}
+
+void OnlineAnalysis::check() {
+  TrendsComparison comparison(entropies.size(), diff_measures, offsets,
+                              kStdDevThreshold);
+  auto anomaly = comparison.detect_anomaly();
+  if (!anomaly.has_value() || comparison.get_margin() < min_confidence) {
+    return;
+  }
+  decided =
+      OnlineDecision{*anomaly, comparison.get_margin(), ciphertext.size()};
+  TRACE_DEBUG(kOnlineDecision, *anomaly + 1, decided->confidence,
+              decided->symbols);
+}
+
+std::optional<OnlineDecision> OnlineAnalysis::finish(ThreadPool *pool) {
+  if (decided.has_value()) {
+    return decided;
+  }
+
+  // Only characters of the alphabet were kept
+  if (ciphertext.size() <
+      EntropyAnalysis::min_length(*candidates, trend_start)) {
+    return std::nullopt;
+  }
+
+  EntropyAnalysis analysis(ciphertext, candidates, trend_start);
+  analysis.use_thread_pool(pool);
+  auto answer = analysis.run();
+  if (!answer.has_value()) {
+    return std::nullopt;
+  }
+  return OnlineDecision{*answer, 0.0f, ciphertext.size()};
+}
@@ -0,0 +1,357 @@
+#include "packed.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PACKED_X86 1
+#include <immintrin.h>
+#endif
+
+PackedStream pack(const Encoded &stream) {
+  return PackedStream(stream.begin(), stream.end());
+}
+
+// Scalar kernels, which define the results the vector ones must reproduce
+
+static void diff_scalar(const std::uint8_t *cipher, const std::uint8_t *plain,
+                        std::uint8_t *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; i++) {
+    out[i] = diff(cipher[i], plain[i]);
+  }
+}
+
+static void count_symbols_scalar(const std::uint8_t *stream, std::size_t n,
+                                 Histogram &histogram) {
+  for (std::size_t i = 0; i < n; i++) {
+    histogram[stream[i]]++;
+  }
+}
+
+static void count_diffs_scalar(const std::uint8_t *cipher,
+                               const std::uint8_t *plain, std::size_t n,
+                               Histogram &histogram) {
+  for (std::size_t i = 0; i < n; i++) {
+    histogram[diff(cipher[i], plain[i])]++;
+  }
+}
+
+#ifdef PACKED_X86
+
+// Vector kernels, for DefaultAlphabet. A modular diff is c - p, plus
+// kAlphabetSize in the lanes where c < p (that is, where max(c, p) != c).
+// Histograms count one bin at a time: a lane compare gives 0xff on a match,
+// and subtracting it adds one to a byte counter, which is widened with a sum
+// of absolute differences before 255 blocks can wrap it.
+
+__attribute__((target("sse2"))) static __m128i diff_block_sse2(__m128i c,
+                                                                __m128i p) {
+  __m128i no_wrap = _mm_cmpeq_epi8(_mm_max_epu8(c, p), c);
+  __m128i d = _mm_sub_epi8(c, p);
+  __m128i wrap = _mm_andnot_si128(no_wrap, _mm_set1_epi8(kAlphabetSize));
+  return _mm_add_epi8(d, wrap);
+}
+
+__attribute__((target("sse2"))) static void count_block_sse2(
+    __m128i v, __m128i *counters) {
+  for (int b = 0; b < (int)kAlphabetSize; b++) {
+    counters[b] =
+        _mm_sub_epi8(counters[b], _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+  }
+}
+
+__attribute__((target("sse2"))) static void flush_sse2(__m128i *counters,
+                                                       Histogram &histogram) {
+  const __m128i zero = _mm_setzero_si128();
+  for (int b = 0; b < (int)kAlphabetSize; b++) {
+    __m128i sums = _mm_sad_epu8(counters[b], zero);
+    histogram[b] += _mm_cvtsi128_si32(sums) +
+                    _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    counters[b] = zero;
+  }
+}
+
+__attribute__((target("sse2"))) static void diff_sse2(
+    const std::uint8_t *cipher, const std::uint8_t *plain, std::uint8_t *out,
+    std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cipher + i));
+    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(plain + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     diff_block_sse2(c, p));
+  }
+  diff_scalar(cipher + i, plain + i, out + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void count_symbols_sse2(
+    const std::uint8_t *stream, std::size_t n, Histogram &histogram) {
+  __m128i counters[kAlphabetSize];
+  std::fill(counters, counters + kAlphabetSize, _mm_setzero_si128());
+  std::size_t i = 0;
+  while (i + 16 <= n) {
+    std::size_t blocks = std::min<std::size_t>((n - i) / 16, 255);
+    for (std::size_t k = 0; k < blocks; k++, i += 16) {
+      count_block_sse2(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(stream + i)),
+          counters);
+    }
+    flush_sse2(counters, histogram);
+  }
+  count_symbols_scalar(stream + i, n - i, histogram);
+}
+
+__attribute__((target("sse2"))) static void count_diffs_sse2(
+    const std::uint8_t *cipher, const std::uint8_t *plain, std::size_t n,
+    Histogram &histogram) {
+  __m128i counters[kAlphabetSize];
+  std::fill(counters, counters + kAlphabetSize, _mm_setzero_si128());
+  std::size_t i = 0;
+  while (i + 16 <= n) {
+    std::size_t blocks = std::min<std::size_t>((n - i) / 16, 255);
+    for (std::size_t k = 0; k < blocks; k++, i += 16) {
+      __m128i c =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(cipher + i));
+      __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(plain + i));
+      count_block_sse2(diff_block_sse2(c, p), counters);
+    }
+    flush_sse2(counters, histogram);
+  }
+  count_diffs_scalar(cipher + i, plain + i, n - i, histogram);
+}
+
+__attribute__((target("avx2"))) static __m256i diff_block_avx2(__m256i c,
+                                                                __m256i p) {
+  __m256i no_wrap = _mm256_cmpeq_epi8(_mm256_max_epu8(c, p), c);
+  __m256i d = _mm256_sub_epi8(c, p);
+  __m256i wrap = _mm256_andnot_si256(no_wrap, _mm256_set1_epi8(kAlphabetSize));
+  return _mm256_add_epi8(d, wrap);
+}
+
+__attribute__((target("avx2"))) static void count_block_avx2(
+    __m256i v, __m256i *counters) {
+  for (int b = 0; b < (int)kAlphabetSize; b++) {
+    counters[b] =
+        _mm256_sub_epi8(counters[b], _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+  }
+}
+
+__attribute__((target("avx2"))) static void flush_avx2(__m256i *counters,
+                                                       Histogram &histogram) {
+  const __m256i zero = _mm256_setzero_si256();
+  for (int b = 0; b < (int)kAlphabetSize; b++) {
+    __m256i sums = _mm256_sad_epu8(counters[b], zero);
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums),
+                                 _mm256_extracti128_si256(sums, 1));
+    histogram[b] +=
+        _mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+    counters[b] = zero;
+  }
+}
+
+__attribute__((target("avx2"))) static void diff_avx2(
+    const std::uint8_t *cipher, const std::uint8_t *plain, std::uint8_t *out,
+    std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cipher + i));
+    __m256i p =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(plain + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        diff_block_avx2(c, p));
+  }
+  diff_sse2(cipher + i, plain + i, out + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void count_symbols_avx2(
+    const std::uint8_t *stream, std::size_t n, Histogram &histogram) {
+  __m256i counters[kAlphabetSize];
+  std::fill(counters, counters + kAlphabetSize, _mm256_setzero_si256());
+  std::size_t i = 0;
+  while (i + 32 <= n) {
+    std::size_t blocks = std::min<std::size_t>((n - i) / 32, 255);
+    for (std::size_t k = 0; k < blocks; k++, i += 32) {
+      count_block_avx2(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(stream + i)),
+          counters);
+    }
+    flush_avx2(counters, histogram);
+  }
+  count_symbols_sse2(stream + i, n - i, histogram);
+}
+
+__attribute__((target("avx2"))) static void count_diffs_avx2(
+    const std::uint8_t *cipher, const std::uint8_t *plain, std::size_t n,
+    Histogram &histogram) {
+  __m256i counters[kAlphabetSize];
+  std::fill(counters, counters + kAlphabetSize, _mm256_setzero_si256());
+  std::size_t i = 0;
+  while (i + 32 <= n) {
+    std::size_t blocks = std::min<std::size_t>((n - i) / 32, 255);
+    for (std::size_t k = 0; k < blocks; k++, i += 32) {
+      __m256i c =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cipher + i));
+      __m256i p =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(plain + i));
+      count_block_avx2(diff_block_avx2(c, p), counters);
+    }
+    flush_avx2(counters, histogram);
+  }
+  count_diffs_sse2(cipher + i, plain + i, n - i, histogram);
+}
+
+#endif  // PACKED_X86
+
+static SimdLevel supported_level() {
+#ifdef PACKED_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SimdLevel::kSse2;
+  }
+#endif
+  return SimdLevel::kScalar;
+}
+
+static std::atomic<SimdLevel> &current_level() {
+  static std::atomic<SimdLevel> level(supported_level());
+  return level;
+}
+
+SimdLevel simd_level() { return current_level().load(); }
+
+SimdLevel set_simd_level(SimdLevel level) {
+  level = std::min(level, supported_level());
+  current_level().store(level);
+  return level;
+}
+
+const char *simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kAvx2:
+      return "avx2";
+    case SimdLevel::kSse2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+std::optional<SimdLevel> parse_simd_level(const std::string &name) {
+  for (SimdLevel level :
+       {SimdLevel::kScalar, SimdLevel::kSse2, SimdLevel::kAvx2}) {
+    if (name == simd_level_name(level)) {
+      return level;
+    }
+  }
+  return std::nullopt;
+}
+
+void diff_streams(const std::uint8_t *cipher, const std::uint8_t *plain,
+                  std::uint8_t *out, std::size_t n) {
+  switch (simd_level()) {
+#ifdef PACKED_X86
+    case SimdLevel::kAvx2:
+      return diff_avx2(cipher, plain, out, n);
+    case SimdLevel::kSse2:
+      return diff_sse2(cipher, plain, out, n);
+#endif
+    default:
+      return diff_scalar(cipher, plain, out, n);
+  }
+}
+
+void count_symbols(const std::uint8_t *stream, std::size_t n,
+                   Histogram &histogram) {
+  switch (simd_level()) {
+#ifdef PACKED_X86
+    case SimdLevel::kAvx2:
+      return count_symbols_avx2(stream, n, histogram);
+    case SimdLevel::kSse2:
+      return count_symbols_sse2(stream, n, histogram);
+#endif
+    default:
+      return count_symbols_scalar(stream, n, histogram);
+  }
+}
+
+void count_diffs(const std::uint8_t *cipher, const std::uint8_t *plain,
+                 std::size_t n, Histogram &histogram) {
+  switch (simd_level()) {
+#ifdef PACKED_X86
+    case SimdLevel::kAvx2:
+      return count_diffs_avx2(cipher, plain, n, histogram);
+    case SimdLevel::kSse2:
+      return count_diffs_sse2(cipher, plain, n, histogram);
+#endif
+    default:
+      return count_diffs_scalar(cipher, plain, n, histogram);
+  }
+}
+
+CandidateStreams::CandidateStreams(const std::vector<Encoded> &candidates)
+    : n_candidates(candidates.size()), stride(0), common_length(0) {
+  for (const auto &c : candidates) {
+    stride = std::max(stride, c.size());
+    owned_lengths.push_back(c.size());
+  }
+  if (!candidates.empty()) {
+    common_length = *std::min_element(owned_lengths.begin(),
+                                      owned_lengths.end());
+  }
+  owned_rows.assign(n_candidates * stride, 0);
+  for (std::size_t p = 0; p < n_candidates; p++) {
+    std::copy(candidates[p].begin(), candidates[p].end(),
+              owned_rows.begin() + p * stride);
+  }
+  rows = owned_rows.data();
+  lengths = owned_lengths.data();
+}
+
+CandidateStreams::CandidateStreams(const std::uint8_t *rows,
+                                   const std::uint64_t *lengths,
+                                   std::size_t n_candidates,
+                                   std::size_t stride,
+                                   std::size_t common_length,
+                                   std::shared_ptr<const void> owner)
+    : n_candidates(n_candidates),
+      stride(stride),
+      common_length(common_length),
+      rows(rows),
+      lengths(lengths),
+      owner(std::move(owner)) {
+  assert(common_length <= stride);
+}
+
+// The cipher is walked once, in chunks small enough to stay in L1 while
+// every candidate is diffed against them
+static const std::size_t kCipherChunk = 4096;
+
+void CandidateStreams::diffs(const std::uint8_t *cipher, std::size_t n,
+                             std::uint8_t *out) const {
+  assert(n <= common_length);
+  for (std::size_t i = 0; i < n; i += kCipherChunk) {
+    std::size_t chunk = std::min(kCipherChunk, n - i);
+    for (std::size_t p = 0; p < n_candidates; p++) {
+      diff_streams(cipher + i, row(p) + i, out + p * n + i, chunk);
+    }
+  }
+}
+
+void CandidateStreams::histograms(const std::uint8_t *cipher, std::size_t n,
+                                  Histogram *out) const {
+  assert(n <= common_length);
+  for (std::size_t p = 0; p < n_candidates; p++) {
+    out[p].fill(0);
+  }
+  for (std::size_t i = 0; i < n; i += kCipherChunk) {
+    std::size_t chunk = std::min(kCipherChunk, n - i);
+    for (std::size_t p = 0; p < n_candidates; p++) {
+      count_diffs(cipher + i, row(p) + i, chunk, out[p]);
+    }
+  }
+}
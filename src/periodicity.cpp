@@ -0,0 +1,119 @@
+#include "periodicity.h"
+
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// exp(-2 pi i r / d) for every d and r < d, shared by every detector
+struct Tables {
+  std::size_t max_length = 0;
+  std::vector<double> re;
+  std::vector<double> im;
+
+  explicit Tables(std::size_t max_length) : max_length(max_length) {
+    const double pi = std::acos(-1.0);
+    re.resize(max_length * (max_length + 1) / 2);
+    im.resize(re.size());
+    for (std::size_t d = 1; d <= max_length; d++) {
+      std::size_t base = (d - 1) * d / 2;
+      for (std::size_t r = 0; r < d; r++) {
+        re[base + r] = std::cos(2.0 * pi * r / d);
+        im[base + r] = -std::sin(2.0 * pi * r / d);
+      }
+    }
+  }
+};
+
+const Tables &shared_tables() {
+  static const Tables tables(256);
+  return tables;
+}
+
+// Bins k < m / 2 of a length m transform with m / gcd(k, m) == d: k = u * m
+// / d for the u coprime with d
+std::size_t lower_half_bins(std::size_t m, std::size_t d) {
+  std::size_t step = m / d;
+  std::size_t count = 0;
+  for (std::size_t u = 0; u * step < m / 2; u++) {
+    if (std::gcd(u, d) == 1) {
+      count++;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+PeriodicityDetector::PeriodicityDetector(std::size_t max_length)
+    : max_length(max_length) {
+  assert(max_length <= shared_tables().max_length);
+  sums.assign(offset(max_length + 1), 0);
+  residues.assign(max_length + 1, 0);
+}
+
+void PeriodicityDetector::clear() {
+  std::fill(sums.begin(), sums.end(), 0);
+  std::fill(residues.begin(), residues.end(), 0);
+  m = 0;
+}
+
+void PeriodicityDetector::push(int x) {
+  assert(m < max_length);
+  for (std::size_t d = 1; d <= max_length; d++) {
+    std::size_t &r = residues[d];
+    sums[offset(d) + r] += x;
+    if (++r == d) {
+      r = 0;
+    }
+  }
+  m++;
+}
+
+bool PeriodicityDetector::is_zero(std::size_t d) const {
+  const Tables &t = shared_tables();
+  const std::size_t base = offset(d);
+  double re = 0.0;
+  double im = 0.0;
+  for (std::size_t r = 0; r < d; r++) {
+    double s = (double)sums[base + r];
+    re += s * t.re[base + r];
+    im += s * t.im[base + r];
+  }
+  return std::sqrt(re * re + im * im) < 1e-5;
+}
+
+std::size_t PeriodicityDetector::zero_bins() const {
+  std::size_t zeros = 0;
+  for (std::size_t d = 1; d * d <= m; d++) {
+    if (m % d != 0) {
+      continue;
+    }
+    std::size_t bins = lower_half_bins(m, d);
+    if (bins > 0 && is_zero(d)) {
+      zeros += bins;
+    }
+    std::size_t e = m / d;
+    if (e == d) {
+      continue;
+    }
+    bins = lower_half_bins(m, e);
+    if (bins > 0 && is_zero(e)) {
+      zeros += bins;
+    }
+  }
+  return zeros;
+}
+
+bool has_periodic_prefix(const Encoded &diffs, std::size_t min_length) {
+  PeriodicityDetector detector(diffs.size());
+  for (std::size_t i = 0; i + 1 < diffs.size(); i++) {
+    detector.push(diffs[i]);
+    std::size_t m = detector.length();
+    if (m >= min_length && detector.zero_bins() >= (m / 2) / 4) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,91 @@
+#include "protocol.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+static std::uint32_t decode_length(const char *header) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(header);
+  return (std::uint32_t)bytes[0] << 24 | (std::uint32_t)bytes[1] << 16 |
+         (std::uint32_t)bytes[2] << 8 | (std::uint32_t)bytes[3];
+}
+
+void append_frame(std::string &out, std::string_view payload) {
+  std::uint32_t length = payload.size();
+  out.push_back((char)(length >> 24));
+  out.push_back((char)(length >> 16));
+  out.push_back((char)(length >> 8));
+  out.push_back((char)length);
+  out.append(payload);
+}
+
+bool take_frame(std::string_view &buffer, std::string_view &payload,
+                bool &malformed) {
+  malformed = false;
+  if (buffer.size() < kFrameHeaderSize) {
+    return false;
+  }
+  std::uint32_t length = decode_length(buffer.data());
+  if (length > kMaxFramePayload) {
+    malformed = true;
+    return false;
+  }
+  if (buffer.size() < kFrameHeaderSize + length) {
+    return false;
+  }
+  payload = buffer.substr(kFrameHeaderSize, length);
+  buffer.remove_prefix(kFrameHeaderSize + length);
+  return true;
+}
+
+static bool write_all(int fd, const char *data, std::size_t n) {
+  while (n > 0) {
+    ssize_t written = write(fd, data, n);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    n -= written;
+  }
+  return true;
+}
+
+static bool read_all(int fd, char *data, std::size_t n) {
+  while (n > 0) {
+    ssize_t got = read(fd, data, n);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    data += got;
+    n -= got;
+  }
+  return true;
+}
+
+bool write_frame(int fd, std::string_view payload) {
+  std::string frame;
+  append_frame(frame, payload);
+  return write_all(fd, frame.data(), frame.size());
+}
+
+std::optional<std::string> read_frame(int fd) {
+  char header[kFrameHeaderSize];
+  if (!read_all(fd, header, sizeof(header))) {
+    return std::nullopt;
+  }
+  std::uint32_t length = decode_length(header);
+  if (length > kMaxFramePayload) {
+    return std::nullopt;
+  }
+  std::string payload(length, '\0');
+  if (!read_all(fd, payload.data(), length)) {
+    return std::nullopt;
+  }
+  return payload;
+}
@@ -0,0 +1,150 @@
+#include "recovery.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include "trace.h"
+
+RecoveryAnalysis::RecoveryAnalysis(const std::string &ciphertext,
+                                   const std::string &plaintext) {
+  for (char c : alphabet_only(ciphertext)) {
+    cipher.push_back(ctoi(c));
+  }
+  for (char c : alphabet_only(plaintext)) {
+    plain.push_back(ctoi(c));
+  }
+  TRACE_INFO(kRecoveryStart);
+}
+
+// Viterbi pass over the band: M(j, d) is the fewest mismatches of plain[0..j]
+// with plain[j] at cipher[j + d], and P(j, d) the minimum of M(j, d') over
+// d' <= d. Then M(j, d) = mismatch(j, d) + P(j - 1, d), since the offsets
+// never decrease, and P(j, d) = min(M(j, d), P(j, d - 1)).
+std::size_t RecoveryAnalysis::align(const std::vector<int> &key) {
+  const std::size_t length = plain.size();
+  const std::size_t band = n_randoms + 1;
+  std::array<std::uint32_t, kMaxBand> best;
+  std::uint32_t last = 0;
+
+  for (std::size_t j = 0; j < length; j++) {
+    int shift = key[(j + 1) % key.size()];
+    std::uint64_t bits = 0;
+    std::uint32_t running = 0;
+    for (std::size_t d = 0; d < band; d++) {
+      std::uint32_t cost = (j == 0) ? 0 : best[d];
+      cost += (diff(cipher[j + d], plain[j]) != shift);
+      if (d > 0 && running < cost) {
+        bits |= std::uint64_t(1) << d;
+      } else {
+        running = cost;
+      }
+      best[d] = running;
+      last = cost;
+    }
+    from_below[j] = bits;
+  }
+
+  // The last cipher character always encrypts the last plaintext character
+  std::size_t mismatches = last;
+  std::size_t d = n_randoms;
+  for (std::size_t j = length; j-- > 0;) {
+    if (j + 1 < length) {
+      while ((from_below[j] >> d) & 1u) {
+        d--;
+      }
+    }
+    positions[j] = j + d;
+  }
+  return mismatches;
+}
+
+std::vector<int> RecoveryAnalysis::initial_key(std::size_t key_length) const {
+  const std::size_t length = plain.size();
+  std::vector<std::array<std::size_t, kAlphabetSize>> votes(key_length);
+  for (auto &slot : votes) {
+    slot.fill(0);
+  }
+  for (std::size_t j = 0; j < length; j++) {
+    std::size_t centre = j * n_randoms / length;
+    std::size_t low = centre > kInitialBand ? centre - kInitialBand : 0;
+    std::size_t high = std::min(centre + kInitialBand, n_randoms);
+    auto &slot = votes[(j + 1) % key_length];
+    for (std::size_t d = low; d <= high; d++) {
+      slot[diff(cipher[j + d], plain[j])]++;
+    }
+  }
+
+  std::vector<int> key;
+  for (const auto &slot : votes) {
+    key.push_back(std::max_element(slot.begin(), slot.end()) - slot.begin());
+  }
+  return key;
+}
+
+std::vector<int> RecoveryAnalysis::path_key(std::size_t key_length) const {
+  std::vector<std::array<std::size_t, kAlphabetSize>> votes(key_length);
+  for (auto &slot : votes) {
+    slot.fill(0);
+  }
+  for (std::size_t j = 0; j < plain.size(); j++) {
+    votes[(j + 1) % key_length][diff(cipher[positions[j]], plain[j])]++;
+  }
+
+  std::vector<int> key;
+  for (const auto &slot : votes) {
+    key.push_back(std::max_element(slot.begin(), slot.end()) - slot.begin());
+  }
+  return key;
+}
+
+KeyRecovery RecoveryAnalysis::recover_with(std::size_t key_length) {
+  KeyRecovery result;
+  result.key = initial_key(key_length);
+  result.mismatches = align(result.key);
+  for (std::size_t round = 0; round < kMaxRounds; round++) {
+    std::vector<int> key = path_key(key_length);
+    if (key == result.key) {
+      break;
+    }
+    result.key = key;
+    result.mismatches = align(result.key);
+  }
+
+  // Cipher positions off the path are the random characters
+  std::size_t j = 0;
+  for (std::size_t i = 0; i < cipher.size(); i++) {
+    if (j < positions.size() && positions[j] == i) {
+      j++;
+    } else {
+      result.random_indices.push_back(i);
+    }
+  }
+  return result;
+}
+
+std::optional<KeyRecovery> RecoveryAnalysis::run() {
+  if (plain.empty() || cipher.size() < plain.size() ||
+      cipher.size() - plain.size() >= kMaxBand) {
+    TRACE_INFO(kRecoveryBand, cipher.size(), plain.size());
+    return std::nullopt;
+  }
+  n_randoms = cipher.size() - plain.size();
+  from_below.assign(plain.size(), 0);
+  positions.assign(plain.size(), 0);
+
+  std::optional<KeyRecovery> best;
+  for (std::size_t t = 1; t <= kMaxKeyLength && t <= plain.size(); t++) {
+    KeyRecovery recovery = recover_with(t);
+    if (!best.has_value() || recovery.mismatches < best->mismatches) {
+      best = std::move(recovery);
+    }
+    if (best->mismatches == 0) {
+      break;
+    }
+  }
+
+  reduce_key_period(best->key);
+  TRACE_INFO(kRecoveryResult, best->key.size(), n_randoms, best->mismatches);
+  return best;
+}
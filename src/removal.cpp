@@ -0,0 +1,100 @@
+#include "removal.h"
+
+#include <cassert>
+
+#include "trace.h"
+
+ShiftedDiffs::ShiftedDiffs(const Encoded &cipher, const std::uint8_t *plain,
+                           std::size_t length, std::size_t max_shift)
+    : length(length), max_shift(max_shift) {
+  assert(length + max_shift <= cipher.size());
+  PackedStream packed_cipher = pack(cipher);
+  diffs.resize(length * (max_shift + 1));
+  for (std::size_t s = 0; s <= max_shift; s++) {
+    diff_streams(packed_cipher.data() + s, plain, diffs.data() + s * length,
+                 length);
+  }
+}
+
+RemovalView::RemovalView(const ShiftedDiffs &cache)
+    : cache(cache), shift(cache.size() + 1, 0) {}
+
+EntropyCounter RemovalView::counter_without(std::size_t i,
+                                            std::size_t end) const {
+  EntropyCounter counter;
+  for (std::size_t j = 0; j < std::min(i, end); j++) {
+    counter.add(at(j));
+  }
+  for (std::size_t j = i; j < end; j++) {
+    counter.add(at_removed(j));
+  }
+  return counter;
+}
+
+void RemovalView::remove(std::size_t i) {
+  if (i >= cache.size()) {
+    return;
+  }
+  assert(shift.back() + 1 < cache.shifts());
+
+  std::size_t index = i + shift[i];
+  removed_indices.insert(
+      std::upper_bound(removed_indices.begin(), removed_indices.end(), index),
+      index);
+
+  // Everything from i on now comes from one character further
+  for (std::size_t j = i; j + 1 < shift.size(); j++) {
+    shift[j] = shift[j + 1] + 1;
+  }
+  shift.back() += 1;
+}
+
+Encoded RemovalView::apply(const Encoded &cipher) const {
+  Encoded result;
+  result.reserve(cipher.size() - removed_indices.size());
+  auto next_removed = removed_indices.begin();
+  for (std::size_t ci = 0; ci < cipher.size(); ci++) {
+    if (next_removed != removed_indices.end() && *next_removed == ci) {
+      next_removed++;
+      continue;
+    }
+    result.push_back(cipher[ci]);
+  }
+  return result;
+}
+
+GreedyRemoval::GreedyRemoval(const Encoded &cipher, const std::uint8_t *plain,
+                             std::size_t search_space,
+                             std::size_t max_removals)
+    : diffs(cipher, plain, search_space, max_removals),
+      view(diffs),
+      search_space(search_space) {
+  TRACE_DEBUG(kOptimizeStart,
+              view.counter_without(search_space, search_space).entropy());
+}
+
+bool GreedyRemoval::step(const std::function<bool()> &cancelled) {
+  // Histogram with the character at `ci` removed, moved along with `ci`
+  EntropyCounter counter = view.counter_without(cursor, search_space);
+  for (std::size_t ci = cursor; ci < search_space; ci++) {
+    if (cancelled && cancelled()) {
+      return false;
+    }
+    float ent = counter.entropy();
+
+    TRACE_VERBOSE(kOptimizeStep, ci, ent);
+
+    if (ent > prev_ent) {
+      min_ci = ci - 1;
+      prev_ent = ent;
+      break;
+    }
+
+    prev_ent = ent;
+    view.advance(counter, ci);
+  }
+  TRACE_DEBUG(kOptimizeRemoval, prev_ent, min_ci);
+  view.remove(min_ci);
+  cursor = min_ci + 1;
+  return true;
+}
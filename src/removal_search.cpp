@@ -0,0 +1,226 @@
+#include "removal_search.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <future>
+#include <random>
+
+RemovalSetSearch::RemovalSetSearch(const ShiftedDiffs &diffs,
+                                   std::size_t n_remove)
+    : diffs(diffs), n_remove(n_remove) {
+  assert(n_remove >= 1);
+  assert(n_remove < diffs.shifts());
+  assert(n_remove <= diffs.size());
+
+  const std::size_t length = diffs.size();
+  reachable.assign((n_remove + 1) * (length + 1), 0);
+  for (std::size_t s = 0; s <= n_remove; s++) {
+    uint32_t *masks = &reachable[s * (length + 1)];
+    for (std::size_t j = length; j-- > 0;) {
+      masks[j] = masks[j + 1] | (1u << diffs.at(s, j));
+    }
+  }
+}
+
+uint32_t RemovalSetSearch::reachable_from(std::size_t shift_lo,
+                                          std::size_t j) const {
+  uint32_t mask = 0;
+  for (std::size_t s = shift_lo; s <= n_remove; s++) {
+    mask |= reachable[s * (diffs.size() + 1) + j];
+  }
+  return mask;
+}
+
+// Lowest entropy reachable once every position from j on is filled with a
+// diff of shift `shift_lo` or more
+float RemovalSetSearch::lower_bound(const EntropyCounter &prefix,
+                                    std::size_t shift_lo,
+                                    std::size_t j) const {
+  int rest = diffs.size() - j;
+  if (rest == 0) {
+    return prefix.entropy();
+  }
+  uint32_t mask = reachable_from(shift_lo, j);
+  float bound = 1000.0f;
+  for (int v = 0; mask != 0; v++, mask >>= 1) {
+    if (mask & 1u) {
+      bound = std::min(bound, prefix.entropy_with(v, rest));
+    }
+  }
+  return bound;
+}
+
+// Removal `level` is tried at every position from `lo` on. Position j of the
+// diffs takes shift s when exactly s removals come before it, i.e. `removed`
+// [s-1] - (s-1) <= j < removed[s] - s. `prefix` holds the diffs before the
+// current position, and `full` additionally the rest at the last shift.
+void RemovalSetSearch::search_from(std::size_t level, std::size_t lo,
+                                   EntropyCounter full, EntropyCounter prefix,
+                                   RemovalSet &removed, float threshold,
+                                   std::vector<RemovalSet> &found) const {
+  const std::size_t last = diffs.size() - n_remove;
+  for (std::size_t x = lo; x <= last; x++) {
+    if (lower_bound(prefix, level, x) >= threshold) {
+      break;
+    }
+
+    removed[level] = x + level;
+    if (level + 1 == n_remove) {
+      if (full.entropy() < threshold) {
+        found.push_back(removed);
+      }
+    } else if (lower_bound(prefix, level + 1, x) < threshold) {
+      search_from(level + 1, x, full, prefix, removed, threshold, found);
+    }
+
+    int d = diffs.at(level, x);
+    full.remove(diffs.at(n_remove, x));
+    full.add(d);
+    prefix.add(d);
+  }
+}
+
+void RemovalSetSearch::search_prefix(const RemovalSet &prefix_removed,
+                                     float threshold,
+                                     std::vector<RemovalSet> &found) const {
+  const std::size_t level = prefix_removed.size();
+  std::size_t lo = 0;
+  if (level > 0) {
+    lo = prefix_removed.back() - (level - 1);
+    if (lo > diffs.size() - n_remove) {
+      return;
+    }
+  }
+
+  EntropyCounter prefix;
+  std::size_t shift = 0;
+  for (std::size_t j = 0; j < lo; j++) {
+    while (shift < level && prefix_removed[shift] - shift <= j) {
+      shift++;
+    }
+    prefix.add(diffs.at(shift, j));
+  }
+  EntropyCounter full = prefix;
+  for (std::size_t j = lo; j < diffs.size(); j++) {
+    full.add(diffs.at(n_remove, j));
+  }
+
+  RemovalSet removed(n_remove);
+  std::copy(prefix_removed.begin(), prefix_removed.end(), removed.begin());
+  search_from(level, lo, full, prefix, removed, threshold, found);
+}
+
+Encoded RemovalSetSearch::diffs_without(const RemovalSet &removed) const {
+  Encoded result(diffs.size());
+  std::size_t shift = 0;
+  for (std::size_t j = 0; j < diffs.size(); j++) {
+    while (shift < removed.size() && removed[shift] - shift <= j) {
+      shift++;
+    }
+    result[j] = diffs.at(shift, j);
+  }
+  return result;
+}
+
+template <std::size_t K>
+void RemovalSetSearch::search_prefixes(
+    std::uint64_t first, std::uint64_t end, float threshold,
+    std::vector<std::vector<RemovalSet>> &found) const {
+  RemovalSet prefix(K);
+  FixedCombination<K> comb(diffs.size(), first, end);
+  for (auto c = comb.next(); c != nullptr; c = comb.next()) {
+    std::copy(c->begin(), c->end(), prefix.begin());
+    search_prefix(prefix, threshold, found[comb.rank()]);
+  }
+}
+
+float RemovalSetSearch::entropy_without(const RemovalSet &removed) const {
+  EntropyCounter counter;
+  for (int d : diffs_without(removed)) {
+    counter.add(d);
+  }
+  return counter.entropy();
+}
+
+std::pair<float, float> RemovalSetSearch::entropy_stats(
+    std::size_t n_samples) const {
+  std::vector<float> ents;
+
+  Combination all(diffs.size(), n_remove);
+  if (all.size() <= n_samples) {
+    RemovalSet removed(n_remove);
+    for (auto c = all.next(); c != nullptr; c = all.next()) {
+      std::copy(c, c + n_remove, removed.begin());
+      ents.push_back(entropy_without(removed));
+    }
+  } else {
+    // Robert Floyd's sampling of n_remove distinct positions
+    std::mt19937 rng(27);
+    RemovalSet removed;
+    for (std::size_t i = 0; i < n_samples; i++) {
+      removed.clear();
+      for (std::size_t j = diffs.size() - n_remove; j < diffs.size(); j++) {
+        std::size_t pick =
+            std::uniform_int_distribution<std::size_t>(0, j)(rng);
+        if (std::find(removed.begin(), removed.end(), pick) != removed.end()) {
+          pick = j;
+        }
+        removed.push_back(pick);
+      }
+      std::sort(removed.begin(), removed.end());
+      ents.push_back(entropy_without(removed));
+    }
+  }
+
+  double sum = 0.0;
+  double sqr_sum = 0.0;
+  for (float e : ents) {
+    sum += e;
+    sqr_sum += (double)e * e;
+  }
+  double avg = sum / ents.size();
+  double var = std::max(0.0, sqr_sum / ents.size() - avg * avg);
+  return {(float)avg, (float)std::sqrt(var)};
+}
+
+std::vector<RemovalSet> RemovalSetSearch::below(float threshold,
+                                                ThreadPool *pool) const {
+  // Independent units of work: every choice of the first (up to 2) removals,
+  // by lexicographic rank
+  std::size_t prefix_size = std::min<std::size_t>(2, n_remove - 1);
+  std::uint64_t n_prefixes =
+      prefix_size == 0 ? 1 : Combination::binomial(diffs.size(), prefix_size);
+
+  std::vector<std::vector<RemovalSet>> found(n_prefixes);
+  auto search_ranks = [&](std::uint64_t first, std::uint64_t end) {
+    if (prefix_size == 0) {
+      search_prefix(RemovalSet(), threshold, found[0]);
+    } else if (prefix_size == 1) {
+      search_prefixes<1>(first, end, threshold, found);
+    } else {
+      search_prefixes<2>(first, end, threshold, found);
+    }
+  };
+
+  if (pool == nullptr) {
+    search_ranks(0, n_prefixes);
+  } else {
+    const std::size_t n_chunks = (n_prefixes + 31) / 32;
+    std::vector<std::future<void>> futures;
+    for (std::size_t i = 0; i < n_chunks; i++) {
+      auto range = Combination::chunk(n_prefixes, n_chunks, i);
+      futures.push_back(pool->submit(
+          [&, range]() { search_ranks(range.first, range.second); }));
+    }
+    for (auto &f : futures) {
+      pool->wait(f);
+    }
+  }
+
+  std::vector<RemovalSet> result;
+  for (auto &f : found) {
+    result.insert(result.end(), f.begin(), f.end());
+  }
+  return result;
+}
@@ -0,0 +1,135 @@
+#include "repeats.h"
+
+#include <algorithm>
+
+RepeatIndex::RepeatIndex(std::string text) : text(text) {
+  build_suffix_array();
+  build_lcp();
+}
+
+// Prefix doubling: suffixes sorted by their first 2k characters, from the
+// ranks of their first k, with two counting sorts per round
+void RepeatIndex::build_suffix_array() {
+  const std::size_t n = text.size();
+  suffix_array.resize(n);
+  if (n == 0) {
+    return;
+  }
+
+  std::vector<std::size_t> rank(n);
+  std::vector<std::size_t> next_rank(n);
+  std::vector<std::size_t> by_second(n);
+  std::vector<std::size_t> count(std::max<std::size_t>(n, 256) + 1);
+
+  for (std::size_t i = 0; i < n; i++) {
+    suffix_array[i] = i;
+    rank[i] = (unsigned char)text[i];
+  }
+  std::sort(suffix_array.begin(), suffix_array.end(),
+            [&](std::size_t a, std::size_t b) { return rank[a] < rank[b]; });
+
+  for (std::size_t k = 1;; k <<= 1) {
+    // Rank 0 stands for "past the end", so real ranks start from 1
+    auto second = [&](std::size_t i) {
+      return i + k < n ? rank[i + k] + 1 : 0;
+    };
+
+    // Sort by the second half: suffixes without one come first, then the
+    // others in the order of the suffix starting k later
+    std::size_t filled = 0;
+    for (std::size_t i = n - std::min(k, n); i < n; i++) {
+      by_second[filled++] = i;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+      if (suffix_array[i] >= k) {
+        by_second[filled++] = suffix_array[i] - k;
+      }
+    }
+
+    // Stable counting sort by the first half
+    std::fill(count.begin(), count.end(), 0);
+    for (std::size_t i = 0; i < n; i++) {
+      count[rank[i] + 1]++;
+    }
+    for (std::size_t r = 1; r < count.size(); r++) {
+      count[r] += count[r - 1];
+    }
+    for (std::size_t i = 0; i < n; i++) {
+      std::size_t s = by_second[i];
+      suffix_array[count[rank[s]]++] = s;
+    }
+
+    next_rank[suffix_array[0]] = 0;
+    for (std::size_t i = 1; i < n; i++) {
+      std::size_t a = suffix_array[i - 1];
+      std::size_t b = suffix_array[i];
+      bool same = rank[a] == rank[b] && second(a) == second(b);
+      next_rank[b] = next_rank[a] + (same ? 0 : 1);
+    }
+    rank.swap(next_rank);
+
+    if (rank[suffix_array[n - 1]] == n - 1 || k >= n) {
+      break;
+    }
+  }
+}
+
+// Kasai et al.: the LCP of the suffix at i + 1 with its predecessor is at
+// least the one at i, minus one
+void RepeatIndex::build_lcp() {
+  const std::size_t n = text.size();
+  lcp.assign(n, 0);
+  std::vector<std::size_t> position(n);
+  for (std::size_t i = 0; i < n; i++) {
+    position[suffix_array[i]] = i;
+  }
+
+  std::size_t h = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    if (position[i] == 0) {
+      h = 0;
+      continue;
+    }
+    std::size_t j = suffix_array[position[i] - 1];
+    while (i + h < n && j + h < n && text[i + h] == text[j + h]) {
+      h++;
+    }
+    lcp[position[i]] = h;
+    if (h > 0) {
+      h--;
+    }
+  }
+}
+
+std::set<std::size_t> RepeatIndex::spacings(std::size_t min_length,
+                                            std::size_t max_length) const {
+  std::set<std::size_t> deltas;
+  std::vector<std::size_t> occurrences;
+
+  for (std::size_t t = min_length; t <= max_length; t++) {
+    std::size_t begin = 0;
+    while (begin < suffix_array.size()) {
+      std::size_t end = begin + 1;
+      while (end < suffix_array.size() && lcp[end] >= t) {
+        end++;
+      }
+
+      if (end - begin >= 2) {
+        occurrences.assign(suffix_array.begin() + begin,
+                           suffix_array.begin() + end);
+        std::sort(occurrences.begin(), occurrences.end());
+
+        std::size_t prev = occurrences[0];
+        for (std::size_t i = 1; i < occurrences.size(); i++) {
+          if (occurrences[i] >= prev + t) {
+            deltas.insert(occurrences[i] - prev);
+            prev = occurrences[i];
+          }
+        }
+      }
+      begin = end;
+    }
+  }
+
+  return deltas;
+}
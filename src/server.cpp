@@ -0,0 +1,406 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "entropy.h"
+#include "metrics.h"
+#include "protocol.h"
+
+// Bytes read from a connection at a time
+static const std::size_t kReadChunk = 65536;
+
+// The server of the process, for the signal handlers
+static volatile std::sig_atomic_t stop_requested = 0;
+static int signal_wake_fd = -1;
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+AnalysisServer::AnalysisServer(
+    std::shared_ptr<const CandidateStreams> candidates,
+    std::size_t search_space, std::size_t n_workers)
+    : candidates(std::move(candidates)),
+      search_space(search_space),
+      metrics_out(&std::cerr),
+      pool(n_workers) {
+  min_length = EntropyAnalysis::min_length(*this->candidates, search_space);
+  if (pipe(wake_fds) == 0) {
+    set_nonblocking(wake_fds[0]);
+    set_nonblocking(wake_fds[1]);
+    signal_wake_fd = wake_fds[1];
+  }
+}
+
+AnalysisServer::~AnalysisServer() {
+  while (!connections.empty()) {
+    close_connection(connections.begin()->first);
+  }
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+  }
+  signal_wake_fd = -1;
+  for (int fd : wake_fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+void AnalysisServer::request_stop() {
+  stop_requested = 1;
+  interrupt();
+}
+
+void AnalysisServer::interrupt() {
+  int fd = signal_wake_fd;
+  if (fd >= 0) {
+    char byte = 0;
+    // A full pipe already wakes the poll thread
+    (void)!write(fd, &byte, 1);
+  }
+}
+
+bool AnalysisServer::listen_on(const std::string &path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "[SERVE] Invalid socket path " << path << "\n";
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  // A socket file left by a server that did not shut down cleanly
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    std::cerr << "[SERVE] Cannot listen on " << path << ": "
+              << std::strerror(errno) << "\n";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  set_nonblocking(fd);
+  listen_fd = fd;
+  socket_path = path;
+  return true;
+}
+
+void AnalysisServer::serve_stdio() {
+  set_nonblocking(STDIN_FILENO);
+  set_nonblocking(STDOUT_FILENO);
+  add_connection(STDIN_FILENO, STDOUT_FILENO, false);
+}
+
+void AnalysisServer::add_connection(int in_fd, int out_fd, bool owns_fds) {
+  Connection connection;
+  connection.in_fd = in_fd;
+  connection.out_fd = out_fd;
+  connection.owns_fds = owns_fds;
+  connections.emplace(next_connection++, std::move(connection));
+}
+
+void AnalysisServer::close_connection(std::uint64_t id) {
+  auto it = connections.find(id);
+  if (it == connections.end()) {
+    return;
+  }
+  if (it->second.owns_fds) {
+    close(it->second.in_fd);
+    if (it->second.out_fd != it->second.in_fd) {
+      close(it->second.out_fd);
+    }
+  }
+  // Answers still on their way to it are dropped by collect_completed
+  connections.erase(it);
+}
+
+void AnalysisServer::accept_connections() {
+  while (true) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    add_connection(fd, fd, true);
+  }
+}
+
+bool AnalysisServer::read_requests(std::uint64_t id, Connection &connection) {
+  char buffer[kReadChunk];
+  ssize_t n = read(connection.in_fd, buffer, sizeof(buffer));
+  if (n < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+  if (n == 0) {
+    connection.input_closed = true;
+    return true;
+  }
+  connection.input.append(buffer, n);
+
+  std::string_view unframed = connection.input;
+  std::string_view payload;
+  bool malformed = false;
+  while (take_frame(unframed, payload, malformed)) {
+    Target target{id, connection.next_seq++, Clock::now()};
+    connection.responses.emplace_back();
+    waiting.push_back(Request{target, std::string(payload)});
+  }
+  if (malformed) {
+    std::cerr << "[SERVE] Closing a connection: request longer than "
+              << kMaxFramePayload << " bytes\n";
+    return false;
+  }
+  connection.input.erase(0, connection.input.size() - unframed.size());
+  return true;
+}
+
+bool AnalysisServer::write_responses(Connection &connection) {
+  while (!connection.responses.empty() &&
+         !connection.responses.front().empty()) {
+    append_frame(connection.output, connection.responses.front());
+    connection.responses.pop_front();
+    connection.first_seq++;
+  }
+  std::size_t written = 0;
+  while (written < connection.output.size()) {
+    ssize_t n = write(connection.out_fd, connection.output.data() + written,
+                      connection.output.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  connection.output.erase(0, written);
+  return true;
+}
+
+bool AnalysisServer::analyzable(const std::string &ciphertext) const {
+  return EntropyAnalysis::analyzable(ciphertext, min_length);
+}
+
+void AnalysisServer::dispatch() {
+  std::size_t n = std::min(waiting.size(), kMaxBatch);
+
+  // Identical ciphertexts of the batch share one analysis
+  std::unordered_map<std::string, std::vector<Target>> distinct;
+  std::vector<std::string> order;
+  for (std::size_t i = 0; i < n; i++) {
+    auto &targets = distinct[waiting[i].ciphertext];
+    if (targets.empty()) {
+      order.push_back(waiting[i].ciphertext);
+    }
+    targets.push_back(waiting[i].target);
+  }
+  waiting.erase(waiting.begin(), waiting.begin() + n);
+  n_outstanding += n;
+
+  for (auto &ciphertext : order) {
+    std::vector<Target> targets = std::move(distinct[ciphertext]);
+    // Rejected at once rather than queued behind real analyses
+    if (!analyzable(ciphertext)) {
+      analyze(std::move(ciphertext), std::move(targets));
+      continue;
+    }
+    pool.submit([this, ciphertext = std::move(ciphertext),
+                 targets = std::move(targets)]() mutable {
+      analyze(std::move(ciphertext), std::move(targets));
+    });
+  }
+}
+
+void AnalysisServer::analyze(std::string ciphertext,
+                             std::vector<Target> targets) {
+  std::optional<std::size_t> answer;
+  if (analyzable(ciphertext)) {
+    EntropyAnalysis analysis(std::move(ciphertext), candidates, search_space);
+    answer = analysis.run();
+  }
+  std::string result = answer.has_value() ? std::to_string(*answer + 1) : "-";
+
+  auto now = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(completed_mutex);
+    for (const auto &target : targets) {
+      auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         now - target.arrived)
+                         .count();
+      metrics().record_stage(Stage::kServerRequest, latency);
+      completed.push_back(Completion{
+          target, result + " " + std::to_string(latency / 1000)});
+    }
+  }
+  interrupt();
+}
+
+void AnalysisServer::collect_completed() {
+  char drain[256];
+  while (read(wake_fds[0], drain, sizeof(drain)) > 0) {
+  }
+
+  std::vector<Completion> answers;
+  {
+    std::lock_guard<std::mutex> lock(completed_mutex);
+    answers.swap(completed);
+  }
+  for (auto &answer : answers) {
+    n_outstanding--;
+    n_answered++;
+    auto it = connections.find(answer.target.connection);
+    if (it == connections.end()) {
+      continue;
+    }
+    Connection &connection = it->second;
+    connection.responses[answer.target.seq - connection.first_seq] =
+        std::move(answer.response);
+  }
+}
+
+std::size_t AnalysisServer::run() {
+  n_answered = 0;
+  std::vector<pollfd> fds;
+  std::vector<std::uint64_t> ids;
+
+  while (true) {
+    if (take_metrics_dump_request()) {
+      metrics().write_json(*metrics_out);
+    }
+    bool stopping = stop_requested != 0;
+    if (stopping && listen_fd >= 0) {
+      close(listen_fd);
+      unlink(socket_path.c_str());
+      listen_fd = -1;
+    }
+
+    // Clients that hung up and have every answer, or that broke off
+    for (auto it = connections.begin(); it != connections.end();) {
+      auto current = it++;
+      const Connection &connection = current->second;
+      if (connection.input_closed && connection.responses.empty() &&
+          connection.output.empty()) {
+        close_connection(current->first);
+      }
+    }
+    if (listen_fd < 0 && connections.empty() && waiting.empty() &&
+        n_outstanding == 0) {
+      break;
+    }
+    if (stopping && waiting.empty() && n_outstanding == 0) {
+      break;
+    }
+
+    // Dispatch the batch once its window is over, or once it is full
+    auto timeout = std::chrono::microseconds(-1);
+    if (!waiting.empty()) {
+      auto age = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - waiting.front().target.arrived);
+      if (age >= batch_window || waiting.size() >= kMaxBatch || stopping) {
+        dispatch();
+      }
+    }
+    if (!waiting.empty()) {
+      auto age = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - waiting.front().target.arrived);
+      timeout = std::max(std::chrono::microseconds(0), batch_window - age);
+    }
+
+    fds.clear();
+    ids.clear();
+    fds.push_back({wake_fds[0], POLLIN, 0});
+    bool accepting = listen_fd >= 0 &&
+                     waiting.size() + n_outstanding < max_outstanding();
+    if (accepting) {
+      fds.push_back({listen_fd, POLLIN, 0});
+    }
+    for (auto &[id, connection] : connections) {
+      short events = 0;
+      if (!connection.input_closed && !stopping &&
+          waiting.size() + n_outstanding < max_outstanding()) {
+        events |= POLLIN;
+      }
+      if (!connection.output.empty()) {
+        events |= POLLOUT;
+      }
+      // The stdio client reads and writes on two descriptors
+      if (connection.in_fd != connection.out_fd && (events & POLLOUT)) {
+        fds.push_back({connection.out_fd, POLLOUT, 0});
+        ids.push_back(id);
+        events &= ~POLLOUT;
+      }
+      // Nothing to wait for on a closed input, not even its hang-up
+      if (events != 0) {
+        fds.push_back({connection.in_fd, events, 0});
+        ids.push_back(id);
+      }
+    }
+
+    timespec ts;
+    ts.tv_sec = timeout.count() / 1000000;
+    ts.tv_nsec = timeout.count() % 1000000 * 1000;
+    int ready = ppoll(fds.data(), fds.size(),
+                      timeout.count() < 0 ? nullptr : &ts, nullptr);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "[SERVE] poll failed: " << std::strerror(errno) << "\n";
+      break;
+    }
+
+    collect_completed();
+    std::size_t first_connection = accepting ? 2 : 1;
+    if (accepting && (fds[1].revents & POLLIN)) {
+      accept_connections();
+    }
+    for (std::size_t i = first_connection; i < fds.size(); i++) {
+      std::uint64_t id = ids[i - first_connection];
+      auto it = connections.find(id);
+      if (it == connections.end()) {
+        continue;
+      }
+      // Write errors show up in write_responses below
+      Connection &connection = it->second;
+      if (fds[i].fd == connection.in_fd && !connection.input_closed &&
+          (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+          !read_requests(id, connection)) {
+        close_connection(id);
+      }
+    }
+    for (auto it = connections.begin(); it != connections.end();) {
+      auto current = it++;
+      if (!write_responses(current->second)) {
+        close_connection(current->first);
+      }
+    }
+  }
+
+  return n_answered;
+}
@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+// Pool and queue index of the calling thread, if it is a pool worker
+static thread_local const ThreadPool *worker_pool = nullptr;
+static thread_local std::size_t worker_index = 0;
+
+ThreadPool::ThreadPool(std::size_t n_threads) {
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < n_threads; i++) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  workers.reserve(n_threads);
+  for (std::size_t i = 0; i < n_threads; i++) {
+    workers.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  cv.notify_all();
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+  WorkQueue &queue = (worker_pool == this) ? *queues[worker_index] : injected;
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    n_queued++;
+  }
+  cv.notify_one();
+}
+
+bool ThreadPool::pop(std::size_t home, std::function<void()> &task) {
+  // Own queue first, newest task first
+  {
+    WorkQueue &queue = *queues[home];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      n_queued--;
+      return true;
+    }
+  }
+
+  // Then the oldest task submitted from outside the pool
+  {
+    std::lock_guard<std::mutex> lock(injected.mutex);
+    if (!injected.tasks.empty()) {
+      task = std::move(injected.tasks.front());
+      injected.tasks.pop_front();
+      n_queued--;
+      return true;
+    }
+  }
+
+  // Then steal the oldest task of another worker
+  for (std::size_t i = 1; i < queues.size(); i++) {
+    WorkQueue &queue = *queues[(home + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      n_queued--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ThreadPool::run_pending_task() {
+  if (n_queued.load() == 0) {
+    return false;
+  }
+  std::size_t home = (worker_pool == this) ? worker_index : 0;
+  std::function<void()> task;
+  if (!pop(home, task)) {
+    return false;
+  }
+  task();
+  return true;
+}
+
+void ThreadPool::work(std::size_t index) {
+  worker_pool = this;
+  worker_index = index;
+
+  while (true) {
+    std::function<void()> task;
+    if (pop(index, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    cv.wait(lock, [this]() { return stopping || n_queued.load() > 0; });
+    if (stopping && n_queued.load() == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Single-producer single-consumer ring: only the owning thread pushes, and
+// only trace_flush pops, under the registry mutex
+struct TraceRing {
+  std::vector<TraceRecord> records;
+  std::atomic<std::uint64_t> head{0};
+  std::atomic<std::uint64_t> tail{0};
+  std::atomic<std::uint64_t> dropped{0};
+
+  TraceRing() : records(kTraceCapacity) {}
+};
+
+static_assert((kTraceCapacity & (kTraceCapacity - 1)) == 0,
+              "kTraceCapacity must be a power of 2");
+
+class TraceRegistry {
+ public:
+  std::mutex mutex;
+  std::vector<std::unique_ptr<TraceRing>> rings;
+
+  void flush(std::ostream &out);
+
+  // Events still buffered at exit are not lost
+  ~TraceRegistry() { flush(std::cerr); }
+};
+
+static TraceRegistry &registry() {
+  static TraceRegistry instance;
+  return instance;
+}
+
+static std::atomic<bool> tracing_enabled{true};
+
+bool tracing() { return tracing_enabled.load(std::memory_order_relaxed); }
+
+void set_tracing(bool enabled) {
+  tracing_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// The rings outlive their threads, so that events of finished threads are
+// still flushed
+static TraceRing &thread_ring() {
+  thread_local TraceRing *ring = nullptr;
+  if (ring == nullptr) {
+    auto owned = std::make_unique<TraceRing>();
+    ring = owned.get();
+    TraceRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.rings.push_back(std::move(owned));
+  }
+  return *ring;
+}
+
+void trace_push(const TraceRecord &record) {
+  TraceRing &ring = thread_ring();
+  std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+  std::uint64_t tail = ring.tail.load(std::memory_order_acquire);
+  if (head - tail == kTraceCapacity) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceRecord &slot = ring.records[head & (kTraceCapacity - 1)];
+  slot = record;
+  slot.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now().time_since_epoch())
+                     .count();
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+static void decode(const TraceRecord &record, std::ostream &out) {
+  const char *format = kTraceFormats[(std::size_t)record.event];
+  std::size_t k = 0;
+  for (const char *c = format; *c != '\0'; c++) {
+    if (*c != '{') {
+      out << *c;
+      continue;
+    }
+    const TraceArg &arg = record.args[k++];
+    char type = *++c;
+    int width = 0;
+    while (*++c != '}') {
+      width = width * 10 + (*c - '0');
+    }
+    switch (type) {
+      case 'i':
+        out << arg.i;
+        break;
+      case 'u':
+        out << std::setw(width) << std::setfill('0') << (std::uint64_t)arg.i;
+        break;
+      case 'f':
+        out << std::setprecision(10) << arg.f;
+        break;
+    }
+  }
+}
+
+void TraceRegistry::flush(std::ostream &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::vector<TraceRecord> records;
+  std::uint64_t dropped = 0;
+  for (auto &ring : rings) {
+    std::uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    std::uint64_t head = ring->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      records.push_back(ring->records[tail & (kTraceCapacity - 1)]);
+    }
+    ring->tail.store(head, std::memory_order_release);
+    dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+  }
+  if (records.empty() && dropped == 0) {
+    return;
+  }
+
+  // Every ring is in time order already; merge them
+  std::stable_sort(records.begin(), records.end(),
+                   [](const TraceRecord &a, const TraceRecord &b) {
+                     return a.time_ns < b.time_ns;
+                   });
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  char fill = out.fill();
+  for (const auto &record : records) {
+    decode(record, out);
+  }
+  if (dropped > 0) {
+    out << "[TRACE] " << dropped << " events dropped\n";
+  }
+  out.flags(flags);
+  out.precision(precision);
+  out.fill(fill);
+  out.flush();
+}
+
+void trace_flush(std::ostream &out) { registry().flush(out); }
+
+void trace_flush() { trace_flush(std::cerr); }
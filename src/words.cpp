@@ -0,0 +1,258 @@
+#include "words.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "coincidence.h"
+#include "trace.h"
+
+WordTrie::WordTrie(const std::vector<std::string> &words) {
+  add_node();
+  std::vector<std::int32_t> word_ends;
+  for (const auto &word : words) {
+    // Words are letters only: a space separates them
+    if (word.empty() || !DefaultAlphabet::contains_all(word) ||
+        word.find(' ') != std::string::npos) {
+      continue;
+    }
+    std::int32_t node = kRoot;
+    for (char c : word) {
+      int symbol = ctoi(c);
+      assert(symbol != 0);
+      if (nodes[node].next[symbol] == kNone) {
+        std::int32_t child = add_node();
+        nodes[node].next[symbol] = child;
+        nodes[node].symbols |= 1u << symbol;
+      }
+      node = nodes[node].next[symbol];
+    }
+    word_ends.push_back(node);
+  }
+
+  // A space after a complete word starts the next one
+  for (std::int32_t node : word_ends) {
+    nodes[node].next[0] = kRoot;
+    nodes[node].symbols |= 1u;
+  }
+
+  // Every factor is a path of the trie, starting from any node
+  factors.resize(kFactorLength + 1);
+  std::size_t n_codes = 1;
+  for (std::size_t m = 1; m <= kFactorLength; m++) {
+    n_codes *= kAlphabetSize;
+    factors[m].assign(n_codes / 64 + 1, 0);
+  }
+  for (std::size_t node = 0; node < nodes.size(); node++) {
+    add_factors(node, 0, 0);
+  }
+}
+
+void WordTrie::add_factors(std::int32_t node, std::size_t depth,
+                           std::size_t code) {
+  if (depth > 0) {
+    factors[depth][code >> 6] |= std::uint64_t(1) << (code & 63);
+  }
+  if (depth == kFactorLength) {
+    return;
+  }
+  std::uint32_t symbols = nodes[node].symbols;
+  for (int symbol = 0; symbols != 0; symbol++, symbols >>= 1) {
+    if (symbols & 1u) {
+      add_factors(nodes[node].next[symbol], depth + 1,
+                  code * kAlphabetSize + symbol);
+    }
+  }
+}
+
+std::int32_t WordTrie::add_node() {
+  Node node;
+  node.next.fill(kNone);
+  nodes.push_back(node);
+  return nodes.size() - 1;
+}
+
+WordAnalysis::WordAnalysis(std::string ciphertext,
+                           const std::vector<std::string> &words)
+    : ciphertext(alphabet_only(ciphertext)), trie(words) {
+  for (char c : this->ciphertext) {
+    cipher.push_back(ctoi(c));
+  }
+  TRACE_INFO(kWordStart);
+}
+
+bool WordAnalysis::random_allowed(std::size_t i) const {
+  std::size_t in_window = 0;
+  for (auto it = randoms.rbegin(); it != randoms.rend(); it++) {
+    if (*it + kRandomWindow <= i) {
+      break;
+    }
+    in_window++;
+  }
+  return in_window < max_randoms;
+}
+
+// Plaintext position j = plain.size() is being encrypted by cipher character
+// i, with its shift just fixed. Positions j - kFactorLength + 1 .. j + t are
+// then decryptable, and the last kFactorLength of them must be a factor under
+// some alignment: position j + t lies r >= 0 random characters past i + t.
+bool WordAnalysis::lookahead(std::size_t i) const {
+  const std::size_t q = WordTrie::kFactorLength;
+  if (plain.size() + 1 < q) {
+    return true;
+  }
+  // Shifts of the lookahead characters, which are those of j - q + 1 .. j
+  int shifts[WordTrie::kFactorLength];
+  for (std::size_t k = 0; k < q; k++) {
+    shifts[k] = key[(plain.size() + k + 2 - q) % key_length];
+  }
+  const std::size_t max_offset = 2 * max_randoms;
+  for (std::size_t r = 0; r <= max_offset; r++) {
+    std::size_t pos = i + key_length + r;
+    if (pos >= cipher.size()) {
+      return true;
+    }
+    if (lookahead_from(pos, q - 1, max_randoms, 0, 1, shifts)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Decrypt the k-th lookahead character from cipher[pos], then the earlier
+// ones from before pos, skipping up to `skips` random characters. `code`
+// holds the characters after the k-th, and `scale` is 27^(q - 1 - k). Every
+// suffix decrypted so far must already be a factor, which cuts most
+// alignments short.
+bool WordAnalysis::lookahead_from(std::size_t pos, std::size_t k,
+                                  std::size_t skips, std::size_t code,
+                                  std::size_t scale,
+                                  const int *shifts) const {
+  const std::size_t q = WordTrie::kFactorLength;
+  code += diff(cipher[pos], shifts[k]) * scale;
+  if (!trie.is_factor(code, q - k)) {
+    return false;
+  }
+  if (k == 0) {
+    return true;
+  }
+  for (std::size_t skip = 0; skip <= skips && skip + 1 <= pos; skip++) {
+    if (lookahead_from(pos - 1 - skip, k - 1, skips - skip, code,
+                       scale * kAlphabetSize, shifts)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Cipher character i encrypts `symbol`, the next plaintext character
+bool WordAnalysis::emit(std::size_t i, std::int32_t node, int symbol) {
+  std::int32_t next = trie.next(node, symbol);
+  if (next == WordTrie::kNone) {
+    return false;
+  }
+  std::size_t slot = (plain.size() + 1) % key_length;
+  key_uses[slot]++;
+  plain.push_back(symbol);
+  if (search(i + 1, next)) {
+    return true;
+  }
+  plain.pop_back();
+  key_uses[slot]--;
+  return false;
+}
+
+// Depth first over the explanations of cipher[i..], the plaintext so far
+// ending at trie `node`: cipher character i is either the next plaintext
+// character under the key, or random
+bool WordAnalysis::search(std::size_t i, std::int32_t node) {
+  if (i == cipher.size()) {
+    return true;
+  }
+  if (++expansions > kMaxExpansions) {
+    return false;
+  }
+
+  std::size_t slot = (plain.size() + 1) % key_length;
+  if (key_uses[slot] > 0) {
+    if (emit(i, node, diff(cipher[i], key[slot]))) {
+      return true;
+    }
+  } else {
+    // First use of this key position: every continuation fixes its shift
+    std::uint32_t symbols = trie.symbols(node);
+    for (int symbol = 0; symbols != 0; symbol++, symbols >>= 1) {
+      if (symbols & 1u) {
+        key[slot] = diff(cipher[i], symbol);
+        if (lookahead(i) && emit(i, node, symbol)) {
+          return true;
+        }
+      }
+    }
+  }
+
+  if (random_allowed(i)) {
+    randoms.push_back(i);
+    if (search(i + 1, node)) {
+      return true;
+    }
+    randoms.pop_back();
+  }
+  return false;
+}
+
+std::optional<WordDecryption> WordAnalysis::decrypt_with(
+    std::size_t key_length, std::size_t max_randoms) {
+  this->key_length = key_length;
+  this->max_randoms = max_randoms;
+  key.assign(key_length, 0);
+  key_uses.assign(key_length, 0);
+  plain.clear();
+  randoms.clear();
+  expansions = 0;
+
+  bool found = search(0, WordTrie::kRoot);
+  if (found) {
+    TRACE_DEBUG(kWordDecrypted, key_length, max_randoms, kRandomWindow,
+                expansions);
+  } else {
+    TRACE_DEBUG(kWordAttempt, key_length, max_randoms, kRandomWindow,
+                expansions);
+  }
+  if (!found) {
+    return std::nullopt;
+  }
+
+  WordDecryption result;
+  for (int p : plain) {
+    result.plaintext.push_back(DefaultAlphabet::character(p));
+  }
+  result.key = key;
+  result.random_indices = randoms;
+  return result;
+}
+
+std::optional<WordDecryption> WordAnalysis::run() {
+  // The most likely key lengths first, then those too short to be ranked
+  CoincidenceAnalysis coincidence_analysis(ciphertext);
+  coincidence_analysis.run();
+  std::vector<std::size_t> key_lengths = coincidence_analysis.ranking();
+  for (std::size_t t = 1; t <= kMaxKeyLength; t++) {
+    if (std::find(key_lengths.begin(), key_lengths.end(), t) ==
+        key_lengths.end()) {
+      key_lengths.push_back(t);
+    }
+  }
+
+  for (std::size_t k = 1; k <= kMaxRandomsPerWindow; k++) {
+    for (std::size_t t : key_lengths) {
+      auto decryption = decrypt_with(t, k);
+      if (!decryption.has_value()) {
+        continue;
+      }
+      reduce_key_period(decryption->key);
+      return decryption;
+    }
+  }
+  return std::nullopt;
+}
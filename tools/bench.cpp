@@ -0,0 +1,399 @@
+// Microbenchmarks of the analysis hot paths, on synthetic inputs.
+//
+//   bench [--filter <substring>] [--min-time <seconds>] [--max-size <chars>]
+//         [--simd <scalar|sse2|avx2>] [--check-simd]
+//
+// Every benchmark runs at input sizes from 600 characters up to 1 MB, and is
+// repeated until it takes at least --min-time. The results are printed as
+// JSON: ns/op, heap allocations/op and throughput, one record per
+// (benchmark, size), so that runs of different commits can be compared.
+//
+// --simd runs the packed kernels at a lower level than the best the CPU
+// supports. Before benchmarking, the diff and histogram kernels of every
+// supported level run on the same inputs and are compared with the scalar
+// ones; --check-simd only does that, and fails if any of them differs.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "coincidence.h"
+#include "columns.h"
+#include "common.h"
+#include "entropy.h"
+#include "generator.h"
+#include "kasiski.h"
+#include "packed.h"
+#include "removal.h"
+#include "trace.h"
+
+// Every heap allocation of the process goes through these
+static std::atomic<std::uint64_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// Keep the compiler from optimizing `value` away
+template <typename T>
+static void keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Access to the private stages of EntropyAnalysis
+class EntropyBenchmark {
+ public:
+  static Counter make_counter(EntropyAnalysis &a, const std::uint8_t *begin,
+                              const std::uint8_t *end) {
+    return a.make_counter(begin, end);
+  }
+  static float compute_entropy(EntropyAnalysis &a, const Counter &counter) {
+    return a.compute_entropy(counter);
+  }
+  static void compute_entropy_trend(EntropyAnalysis &a,
+                                    const std::uint8_t *begin,
+                                    const std::uint8_t *end, int initial,
+                                    float *trend) {
+    a.compute_entropy_trend(begin, end, initial, trend);
+  }
+};
+
+// Synthetic inputs: text with English letter frequencies, and its encryption
+// by CipherGenerator with a random key
+class Synthetic {
+ private:
+  std::mt19937_64 rng;
+  std::discrete_distribution<int> symbols;
+
+ public:
+  explicit Synthetic(std::uint64_t seed)
+      : rng(seed),
+        symbols({18.3, 6.5, 1.3, 2.2, 3.3, 10.3, 1.8, 1.6, 5.0, 5.7, 0.1,
+                 0.6, 3.3, 2.0, 5.7, 6.2, 1.5, 0.1, 5.0, 5.3, 7.5, 2.3, 0.8,
+                 1.7, 0.1, 1.4, 0.1}) {}
+
+  std::string text(std::size_t length) {
+    std::string s;
+    s.reserve(length);
+    for (std::size_t i = 0; i < length; i++) {
+      int symbol = symbols(rng);
+      s.push_back(DefaultAlphabet::character(symbol));
+    }
+    return s;
+  }
+
+  std::string encrypt(const std::string &plaintext, std::size_t key_length) {
+    CipherGenerator generator(rng());
+    return generator.encrypt(plaintext, generator.random_key(key_length))
+        .ciphertext;
+  }
+};
+
+class Bench {
+ private:
+  std::string filter;
+  double min_time = 0.2;
+  std::size_t max_size = 1 << 20;
+  bool first = true;
+
+ public:
+  static constexpr std::size_t kSizes[] = {600, 4096, 65536, 1 << 20};
+
+  std::string simd;
+  bool check_simd_only = false;
+
+  Bench(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--check-simd") {
+        check_simd_only = true;
+      } else if (i + 1 == argc) {
+        break;
+      } else if (arg == "--filter") {
+        filter = argv[++i];
+      } else if (arg == "--min-time") {
+        min_time = atof(argv[++i]);
+      } else if (arg == "--max-size") {
+        max_size = atol(argv[++i]);
+      } else if (arg == "--simd") {
+        simd = argv[++i];
+      }
+    }
+  }
+
+  bool wanted(const std::string &name, std::size_t size) const {
+    return size <= max_size && name.find(filter) != std::string::npos;
+  }
+
+  // Time `op` on an input of `size` characters, which processes `bytes`
+  // bytes per call, and print its record
+  void measure(const std::string &name, std::size_t size, std::size_t bytes,
+               const std::function<void()> &op) {
+    using clock = std::chrono::steady_clock;
+    op();
+
+    std::uint64_t iterations = 1;
+    double elapsed = 0.0;
+    std::uint64_t allocated = 0;
+    while (true) {
+      std::uint64_t before = allocations.load();
+      auto start = clock::now();
+      for (std::uint64_t i = 0; i < iterations; i++) {
+        op();
+      }
+      elapsed = std::chrono::duration<double>(clock::now() - start).count();
+      allocated = allocations.load() - before;
+      if (elapsed >= min_time) {
+        break;
+      }
+      double scale = elapsed > 0.0 ? 1.2 * min_time / elapsed : 100.0;
+      iterations *= std::max<std::uint64_t>(2, std::min(scale, 100.0));
+    }
+
+    double ns_per_op = elapsed * 1e9 / iterations;
+    std::cout << (first ? "\n" : ",\n") << "    {\"name\": \"" << name
+              << "\", \"size\": " << size << ", \"iterations\": " << iterations
+              << ", \"ns_per_op\": " << ns_per_op
+              << ", \"allocs_per_op\": " << (double)allocated / iterations
+              << ", \"mb_per_s\": " << bytes / ns_per_op * 1e3 << "}"
+              << std::flush;
+    first = false;
+  }
+};
+
+constexpr std::size_t Bench::kSizes[];
+
+static const std::size_t kSearchSpace = 120;
+
+// Run diff_streams, count_symbols and count_diffs at every level the CPU
+// supports on the same random symbols, and compare them with the scalar
+// kernels. Returns false, with the first difference on stderr, if any.
+static bool check_simd_levels() {
+  const SimdLevel in_use = simd_level();
+  // Around the 16 and 32 symbol blocks, and past the flushes of the 8-bit
+  // lane counters of the histogram kernels
+  const std::size_t kLengths[] = {0,  1,   15,  16,   17,   31,
+                                  32, 33,  255, 4095, 8193, 70001};
+  std::mt19937_64 rng(27);
+  std::uniform_int_distribution<int> symbol(0, kAlphabetSize - 1);
+
+  bool agree = true;
+  for (std::size_t n : kLengths) {
+    std::vector<std::uint8_t> cipher(n), plain(n);
+    for (std::size_t i = 0; i < n; i++) {
+      cipher[i] = symbol(rng);
+      plain[i] = symbol(rng);
+    }
+
+    auto run = [&](std::vector<std::uint8_t> &diffs, Histogram &symbols,
+                   Histogram &diff_counts) {
+      diffs.assign(n, 0);
+      symbols.fill(0);
+      diff_counts.fill(0);
+      diff_streams(cipher.data(), plain.data(), diffs.data(), n);
+      count_symbols(cipher.data(), n, symbols);
+      count_diffs(cipher.data(), plain.data(), n, diff_counts);
+    };
+
+    set_simd_level(SimdLevel::kScalar);
+    std::vector<std::uint8_t> expected_diffs;
+    Histogram expected_symbols, expected_counts;
+    run(expected_diffs, expected_symbols, expected_counts);
+
+    for (SimdLevel level : {SimdLevel::kSse2, SimdLevel::kAvx2}) {
+      if (set_simd_level(level) != level) {
+        continue;
+      }
+      std::vector<std::uint8_t> diffs;
+      Histogram symbols, counts;
+      run(diffs, symbols, counts);
+      const char *kernel = diffs != expected_diffs       ? "diff_streams"
+                           : symbols != expected_symbols ? "count_symbols"
+                           : counts != expected_counts   ? "count_diffs"
+                                                         : nullptr;
+      if (kernel != nullptr) {
+        std::cerr << "[BENCH] " << kernel << " at " << simd_level_name(level)
+                  << " differs from scalar on " << n << " symbols\n";
+        agree = false;
+      }
+    }
+  }
+  set_simd_level(in_use);
+  return agree;
+}
+
+int main(int argc, char *argv[]) {
+  Bench bench(argc, argv);
+  set_tracing(false);
+
+  if (!bench.simd.empty()) {
+    auto level = parse_simd_level(bench.simd);
+    if (!level.has_value()) {
+      std::cerr << "Unknown SIMD level " << bench.simd << "\n";
+      return 2;
+    }
+    if (set_simd_level(*level) != *level) {
+      std::cerr << "The CPU does not support " << bench.simd << "\n";
+      return 2;
+    }
+  }
+
+  bool simd_agree = check_simd_levels();
+  if (bench.check_simd_only) {
+    std::cout << (simd_agree ? "The packed kernels agree"
+                             : "The packed kernels differ")
+              << " at the SIMD levels the CPU supports\n";
+    return simd_agree ? 0 : 1;
+  }
+
+  std::cout << "{\n  \"simd\": \"" << simd_level_name(simd_level())
+            << "\",\n  \"simd_levels_agree\": "
+            << (simd_agree ? "true" : "false") << ",\n  \"benchmarks\": [";
+
+  for (std::size_t size : Bench::kSizes) {
+    Synthetic synthetic(size);
+    std::vector<std::string> plaintexts;
+    for (std::size_t p = 0; p < 5; p++) {
+      plaintexts.push_back(synthetic.text(size));
+    }
+    std::string ciphertext = synthetic.encrypt(plaintexts[0], 7);
+    std::vector<std::uint8_t> diffs(size);
+    for (std::size_t i = 0; i < size; i++) {
+      diffs[i] = diff(ctoi(ciphertext[i]), ctoi(plaintexts[1][i]));
+    }
+
+    if (bench.wanted("encode", size)) {
+      bench.measure("encode", size, ciphertext.size(),
+                    [&]() { keep(encode(ciphertext)); });
+    }
+
+    // The removal search sees a third of the plaintext as its search space
+    EntropyAnalysis analysis(ciphertext, plaintexts, size / 3);
+
+    if (bench.wanted("make_counter/compute_entropy", size)) {
+      bench.measure("make_counter/compute_entropy", size, size, [&]() {
+        Counter counter = EntropyBenchmark::make_counter(
+            analysis, diffs.data(), diffs.data() + size);
+        keep(EntropyBenchmark::compute_entropy(analysis, counter));
+      });
+    }
+
+    if (bench.wanted("compute_entropy_trend", size)) {
+      std::vector<float> trend(size);
+      bench.measure("compute_entropy_trend", size, size, [&]() {
+        EntropyBenchmark::compute_entropy_trend(
+            analysis, diffs.data(), diffs.data() + size, size / 3,
+            trend.data());
+        keep(trend[0]);
+      });
+    }
+
+    // The same trend over the symbols of every alphabet policy
+    auto trend_of = [&](auto alphabet, const char *name) {
+      using A = decltype(alphabet);
+      std::string full_name = std::string("extend_entropy_trend/") + name;
+      if (!bench.wanted(full_name, size)) {
+        return;
+      }
+      std::vector<std::uint8_t> symbols(size);
+      for (std::size_t i = 0; i < size; i++) {
+        symbols[i] = A::diff(diffs[i] % A::kSize, i % A::kSize);
+      }
+      std::vector<float> trend(size);
+      bench.measure(full_name, size, size, [&]() {
+        BasicEntropyCounter<A> counter;
+        extend_entropy_trend(counter, symbols.data(),
+                             symbols.data() + size, trend.data());
+        keep(trend[0]);
+      });
+    };
+    trend_of(Alphabet<Letters>(), "letters");
+    trend_of(DefaultAlphabet(), "space_letters");
+    trend_of(Alphabet<Bytes>(), "bytes");
+
+    // Five candidates as in test 1, and enough for the median comparison
+    for (std::size_t n_trends : {std::size_t(5), std::size_t(128)}) {
+      std::string name = "TrendsComparison/" + std::to_string(n_trends);
+      if (!bench.wanted(name, size)) {
+        continue;
+      }
+      std::vector<float> trends(n_trends * size);
+      std::mt19937 rng(n_trends);
+      std::uniform_real_distribution<float> entropy(3.9f, 4.1f);
+      for (auto &e : trends) {
+        e = entropy(rng);
+      }
+      bench.measure(name, size, trends.size() * sizeof(float), [&]() {
+        TrendsComparison comparison(trends, n_trends, 0.9f);
+        keep(comparison.detect_anomaly());
+      });
+    }
+
+    // Four greedy removals against one candidate, over a third of the input
+    if (bench.wanted("GreedyRemoval", size)) {
+      Encoded cipher_stream = encode(ciphertext);
+      PackedStream plain = pack(encode(plaintexts[1]));
+      bench.measure("GreedyRemoval", size, size / 3, [&]() {
+        GreedyRemoval greedy(cipher_stream, plain.data(), size / 3, 4);
+        for (int step = 0; step < 4; step++) {
+          greedy.step();
+        }
+        keep(greedy.apply(cipher_stream));
+      });
+    }
+
+    // Every key length of test 1 against every candidate, in one pass each
+    if (bench.wanted("ColumnScoring", size)) {
+      auto candidates = encode_candidates(plaintexts);
+      Encoded cipher_stream = encode(ciphertext);
+      std::vector<std::size_t> key_lengths;
+      for (std::size_t t = CoincidenceAnalysis::kMinPeriod;
+           t <= CoincidenceAnalysis::kMaxPeriod; t++) {
+        key_lengths.push_back(t);
+      }
+      bench.measure("ColumnScoring", size, size, [&]() {
+        ColumnScoring scoring(cipher_stream, candidates, key_lengths);
+        keep(scoring.run());
+      });
+    }
+
+    // The whole analysis at the default search space: once the trends are
+    // flat, it runs a removal search per expected random character, which
+    // is cubic in the search space
+    if (bench.wanted("EntropyAnalysis::run", size)) {
+      auto candidates = encode_candidates(plaintexts);
+      bench.measure("EntropyAnalysis::run", size, size, [&]() {
+        EntropyAnalysis run_analysis(ciphertext, candidates, kSearchSpace);
+        keep(run_analysis.run());
+      });
+    }
+
+    if (bench.wanted("KasiskiAnalysis::run", size)) {
+      bench.measure("KasiskiAnalysis::run", size, ciphertext.size(), [&]() {
+        KasiskiAnalysis kasiski(ciphertext);
+        keep(kasiski.run());
+      });
+    }
+  }
+
+  std::cout << "\n  ]\n}\n";
+  return 0;
+}
@@ -0,0 +1,168 @@
+// Send test 1 ciphertexts to main serve and report its answers and latencies.
+//
+//   client <socket> [-c <connections>]
+//
+// The ciphertexts come one per line from stdin, and are spread round robin
+// over the connections. Each connection sends all of its requests without
+// waiting, as the protocol allows, and reads the answers as they come back,
+// so concurrent requests reach the server together and get batched. The
+// output has one "<line> <answer> <server_us> <round_trip_us>" line per
+// ciphertext, in input order: the latency the server measured, and the one
+// the client saw, queueing included. A summary goes to stderr.
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "protocol.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Exchange {
+  std::string ciphertext;
+  Clock::time_point sent;
+  std::string response;
+  std::uint64_t round_trip_ns = 0;
+};
+
+static int connect_to(const std::string &path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 &&
+      connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+          0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Exchange the requests of `mine` (indices into `exchanges`) on `fd`; returns
+// false if the server went away before answering all of them
+static bool run_connection(int fd, std::vector<Exchange> &exchanges,
+                           const std::vector<std::size_t> &mine) {
+  std::thread sender([&]() {
+    for (std::size_t i : mine) {
+      exchanges[i].sent = Clock::now();
+      if (!write_frame(fd, exchanges[i].ciphertext)) {
+        break;
+      }
+    }
+    shutdown(fd, SHUT_WR);
+  });
+
+  bool complete = true;
+  for (std::size_t i : mine) {
+    auto response = read_frame(fd);
+    if (!response.has_value()) {
+      complete = false;
+      break;
+    }
+    exchanges[i].response = std::move(*response);
+    exchanges[i].round_trip_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - exchanges[i].sent)
+            .count();
+  }
+  sender.join();
+  close(fd);
+  return complete;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: client <socket> [-c <connections>]\n";
+    return 2;
+  }
+  std::string socket_path = argv[1];
+  std::size_t n_connections = 1;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (std::string(argv[i]) == "-c") {
+      n_connections = std::max(1, atoi(argv[i + 1]));
+    }
+  }
+
+  std::vector<Exchange> exchanges;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (!line.empty()) {
+      exchanges.push_back(Exchange{line, {}, {}, 0});
+    }
+  }
+
+  std::vector<int> fds;
+  std::vector<std::vector<std::size_t>> assigned(n_connections);
+  for (std::size_t c = 0; c < n_connections; c++) {
+    int fd = connect_to(socket_path);
+    if (fd < 0) {
+      std::cerr << "Cannot connect to " << socket_path << ": "
+                << std::strerror(errno) << "\n";
+      for (int open_fd : fds) {
+        close(open_fd);
+      }
+      return 1;
+    }
+    fds.push_back(fd);
+  }
+  for (std::size_t i = 0; i < exchanges.size(); i++) {
+    assigned[i % n_connections].push_back(i);
+  }
+
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  std::vector<char> complete(n_connections, 0);
+  for (std::size_t c = 0; c < n_connections; c++) {
+    threads.emplace_back([&, c]() {
+      complete[c] = run_connection(fds[c], exchanges, assigned[c]);
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  LatencyHistogram round_trips;
+  std::size_t n_answered = 0;
+  for (std::size_t i = 0; i < exchanges.size(); i++) {
+    const Exchange &e = exchanges[i];
+    if (e.response.empty()) {
+      continue;
+    }
+    std::cout << (i + 1) << ' ' << e.response << ' ' << e.round_trip_ns / 1000
+              << '\n';
+    round_trips.record(e.round_trip_ns);
+    n_answered++;
+  }
+  std::cout.flush();
+
+  std::cerr << "Answered " << n_answered << " of " << exchanges.size()
+            << " requests on " << n_connections << " connections in "
+            << seconds << " s (" << (seconds > 0 ? n_answered / seconds : 0)
+            << " requests/s)\nRound trips: ";
+  round_trips.write_json(std::cerr);
+  std::cerr << "\n";
+
+  for (char c : complete) {
+    if (!c) {
+      std::cerr << "The server closed a connection early\n";
+      return 1;
+    }
+  }
+  return 0;
+}
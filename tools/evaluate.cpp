@@ -0,0 +1,296 @@
+// Accuracy and throughput of test 1 on generated ciphertexts, in memory.
+//
+//   evaluate [--cases <n>] [--key-lengths <min>-<max>]
+//            [--search-spaces <s1,s2,...>] [--seed <seed>] [-j <workers>]
+//            [--online <min_confidence>] [--simd <scalar|sse2|avx2>]
+//
+// Every case picks one of the candidate plaintexts of resources/plaintext1.txt
+// and a key length uniformly, and encrypts it with CipherGenerator. Case i
+// only depends on (seed, i), so a run is reproducible whatever the number of
+// workers. Each search space analyzes the same cases. The report gives the
+// accuracy per key length and the latency percentiles of one analysis.
+//
+// With --online, every ciphertext is fed to OnlineAnalysis in chunks of
+// kChunkSize characters instead, and the report also tells how many cases
+// it decided early, how accurately, and after how many symbols.
+//
+// A search space of "auto" runs the adaptive mode of EntropyAnalysis, and the
+// report also tells how many cases every resolution decided, and how
+// accurately.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "dictionary.h"
+#include "entropy.h"
+#include "generator.h"
+#include "online.h"
+#include "packed.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// Cases analyzed by one pool task
+static const std::size_t kCasesPerTask = 256;
+
+// Characters per chunk in --online mode
+static const std::size_t kChunkSize = 64;
+
+struct Options {
+  std::size_t n_cases = 10000;
+  std::size_t min_key_length = 4;
+  std::size_t max_key_length = 24;
+  std::vector<std::size_t> search_spaces = {60, 120};
+  std::uint64_t seed = 1;
+  std::size_t n_workers = 0;
+  bool online = false;
+  float min_confidence = OnlineAnalysis::kMinConfidence;
+};
+
+// Outcome of the cases of one task, at one search space
+struct TaskResult {
+  std::vector<std::size_t> correct;  // per key length
+  std::vector<std::size_t> total;
+  std::vector<float> latencies_us;
+
+  // --online: cases decided before the end of the ciphertext
+  std::size_t early = 0;
+  std::size_t early_correct = 0;
+  std::size_t early_symbols = 0;
+
+  // Adaptive mode: cases and correct answers per decided search space
+  std::map<std::size_t, std::pair<std::size_t, std::size_t>> resolutions;
+};
+
+static Options parse_options(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    std::string value = argv[i + 1];
+    if (arg == "--cases") {
+      options.n_cases = std::stoull(value);
+    } else if (arg == "--key-lengths") {
+      std::size_t dash = value.find('-');
+      options.min_key_length = std::stoull(value.substr(0, dash));
+      options.max_key_length = dash == std::string::npos
+                                   ? options.min_key_length
+                                   : std::stoull(value.substr(dash + 1));
+    } else if (arg == "--search-spaces") {
+      options.search_spaces.clear();
+      std::istringstream list(value);
+      std::string item;
+      while (std::getline(list, item, ',')) {
+        options.search_spaces.push_back(item == "auto"
+                                            ? EntropyAnalysis::kAdaptive
+                                            : std::stoull(item));
+      }
+    } else if (arg == "--seed") {
+      options.seed = std::stoull(value);
+    } else if (arg == "-j") {
+      options.n_workers = std::stoull(value);
+    } else if (arg == "--simd") {
+      auto level = parse_simd_level(value);
+      if (!level.has_value() || set_simd_level(*level) != *level) {
+        std::cerr << "Unknown or unsupported SIMD level " << value << "\n";
+        exit(2);
+      }
+    } else if (arg == "--online") {
+      options.online = true;
+      options.min_confidence = std::stof(value);
+    } else {
+      std::cerr << "Unknown option " << arg << "\n";
+      exit(2);
+    }
+  }
+  return options;
+}
+
+static TaskResult evaluate_cases(const Options &options,
+                                 const std::vector<std::string> &plaintexts,
+                                 const std::shared_ptr<const CandidateStreams>
+                                     &candidates,
+                                 std::size_t search_space, std::size_t first,
+                                 std::size_t end) {
+  using clock = std::chrono::steady_clock;
+  TaskResult result;
+  result.correct.assign(options.max_key_length + 1, 0);
+  result.total.assign(options.max_key_length + 1, 0);
+  result.latencies_us.reserve(end - first);
+
+  for (std::size_t i = first; i < end; i++) {
+    CipherGenerator generator(options.seed, i);
+    std::size_t key_length =
+        options.min_key_length +
+        generator.uniform(options.max_key_length - options.min_key_length + 1);
+    std::size_t answer = generator.uniform(plaintexts.size());
+    auto cipher = generator.encrypt(plaintexts[answer],
+                                    generator.random_key(key_length));
+
+    auto start = clock::now();
+    std::optional<std::size_t> guess;
+    if (options.online) {
+      OnlineAnalysis analysis(candidates, search_space,
+                              options.min_confidence);
+      std::string_view text = cipher.ciphertext;
+      for (std::size_t at = 0; at < text.size() && !analysis.decision();
+           at += kChunkSize) {
+        analysis.feed(text.substr(at, kChunkSize));
+      }
+      if (analysis.decision().has_value()) {
+        result.early++;
+        result.early_symbols += analysis.decision()->symbols;
+        result.early_correct += analysis.decision()->candidate == answer;
+      }
+      auto decision = analysis.finish();
+      if (decision.has_value()) {
+        guess = decision->candidate;
+      }
+    } else {
+      EntropyAnalysis analysis(cipher.ciphertext, candidates, search_space);
+      guess = analysis.run();
+      if (search_space == EntropyAnalysis::kAdaptive) {
+        auto &resolution = result.resolutions[analysis.get_search_space()];
+        resolution.first++;
+        resolution.second += guess.has_value() && guess.value() == answer;
+      }
+    }
+    auto elapsed = std::chrono::duration<float, std::micro>(clock::now() -
+                                                            start);
+
+    result.latencies_us.push_back(elapsed.count());
+    result.total[key_length]++;
+    if (guess.has_value() && guess.value() == answer) {
+      result.correct[key_length]++;
+    }
+  }
+  return result;
+}
+
+static float percentile(const std::vector<float> &sorted, double q) {
+  std::size_t index = (std::size_t)(q * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+  Options options = parse_options(argc, argv);
+  if (options.min_key_length == 0 ||
+      options.min_key_length > options.max_key_length ||
+      options.n_cases == 0) {
+    std::cerr << "Invalid key lengths or number of cases\n";
+    return 2;
+  }
+  if (options.online &&
+      std::count(options.search_spaces.begin(), options.search_spaces.end(),
+                 EntropyAnalysis::kAdaptive) > 0) {
+    std::cerr << "--online needs fixed search spaces\n";
+    return 2;
+  }
+  std::vector<std::string> plaintexts =
+      read_corpus("resources/plaintext1.txt");
+  if (plaintexts.empty()) {
+    std::cerr << "Cannot read resources/plaintext1.txt\n";
+    return 1;
+  }
+  auto candidates = encode_candidates(plaintexts);
+
+  set_tracing(false);
+  ThreadPool pool(options.n_workers);
+  std::cout << "Evaluating " << options.n_cases << " cases on " << pool.size()
+            << " workers, seed " << options.seed << ", "
+            << simd_level_name(simd_level()) << " kernels\n";
+
+  for (std::size_t search_space : options.search_spaces) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<TaskResult>> futures;
+    for (std::size_t first = 0; first < options.n_cases;
+         first += kCasesPerTask) {
+      std::size_t end = std::min(first + kCasesPerTask, options.n_cases);
+      futures.push_back(pool.submit([&, search_space, first, end]() {
+        return evaluate_cases(options, plaintexts, candidates, search_space,
+                              first, end);
+      }));
+    }
+
+    TaskResult total;
+    total.correct.assign(options.max_key_length + 1, 0);
+    total.total.assign(options.max_key_length + 1, 0);
+    total.latencies_us.reserve(options.n_cases);
+    for (auto &f : futures) {
+      TaskResult part = pool.wait(f);
+      for (std::size_t t = 0; t <= options.max_key_length; t++) {
+        total.correct[t] += part.correct[t];
+        total.total[t] += part.total[t];
+      }
+      total.latencies_us.insert(total.latencies_us.end(),
+                                part.latencies_us.begin(),
+                                part.latencies_us.end());
+      total.early += part.early;
+      total.early_correct += part.early_correct;
+      total.early_symbols += part.early_symbols;
+      for (const auto &[resolution, counts] : part.resolutions) {
+        total.resolutions[resolution].first += counts.first;
+        total.resolutions[resolution].second += counts.second;
+      }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::size_t n_correct = 0;
+    std::cout << "\nsearch_space ";
+    if (search_space == EntropyAnalysis::kAdaptive) {
+      std::cout << "auto\n";
+    } else {
+      std::cout << search_space << "\n";
+    }
+    std::cout << "key_length    cases  accuracy\n";
+    std::cout << std::fixed << std::setprecision(4);
+    for (std::size_t t = options.min_key_length; t <= options.max_key_length;
+         t++) {
+      n_correct += total.correct[t];
+      std::cout << std::setw(10) << t << std::setw(9) << total.total[t]
+                << std::setw(10)
+                << (total.total[t] ? (double)total.correct[t] / total.total[t]
+                                   : 0.0)
+                << "\n";
+    }
+    std::cout << "       all" << std::setw(9) << options.n_cases
+              << std::setw(10) << (double)n_correct / options.n_cases << "\n";
+
+    std::vector<float> &latencies = total.latencies_us;
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setprecision(1) << "latency_us p50 "
+              << percentile(latencies, 0.5) << " p90 "
+              << percentile(latencies, 0.9) << " p99 "
+              << percentile(latencies, 0.99) << " p99.9 "
+              << percentile(latencies, 0.999) << " max " << latencies.back()
+              << "\n";
+    std::cout << "throughput " << options.n_cases / seconds << " cases/s\n";
+    if (options.online) {
+      std::cout << std::setprecision(4) << "online: " << total.early
+                << " decided early, accuracy "
+                << (total.early ? (double)total.early_correct / total.early
+                                : 0.0)
+                << ", " << (total.early ? total.early_symbols / total.early : 0)
+                << " symbols on average\n";
+    }
+    if (!total.resolutions.empty()) {
+      std::cout << std::setprecision(4) << "resolution    cases  accuracy\n";
+      for (const auto &[resolution, counts] : total.resolutions) {
+        std::cout << std::setw(10) << resolution << std::setw(9)
+                  << counts.first << std::setw(10)
+                  << (double)counts.second / counts.first << "\n";
+      }
+    }
+    std::cout.unsetf(std::ios::floatfield);
+  }
+  return 0;
+}